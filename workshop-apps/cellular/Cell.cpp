@@ -7,35 +7,70 @@
 #include <glm/geometric.hpp>
 #include <glm/gtx/norm.hpp>
 
+#include <algorithm>
+
 namespace cellular
 {
   Parameters parameters{};
 
-  glm::vec3 newCellPosition(ws::OMesh &oMesh, int32_t vIx)
+  // vertices per task of the thread pool
+  constexpr size_t chunkSize = 256;
+
+  void MeshSnapshot::capture(const ws::OMesh &oMesh, ws::ThreadPool *threadPool)
+  {
+    // OpenMesh is only read here, which is safe from many threads
+    const size_t numVertices = oMesh.n_vertices();
+    positions.resize(numVertices);
+    normals.resize(numVertices);
+    neighborStarts.resize(numVertices + 1);
+    neighborStarts[0] = 0;
+    ws::forEachChunk(threadPool, numVertices, chunkSize, [&](size_t, size_t begin, size_t end)
+                     {
+      for (size_t ix = begin; ix < end; ++ix)
+      {
+        const ws::OMesh::VertexHandle vh{static_cast<int>(ix)};
+        const ws::OMesh::Point p = oMesh.point(vh);
+        const ws::OMesh::Normal n = oMesh.calc_normal(vh);
+        positions[ix] = {p[0], p[1], p[2]};
+        normals[ix] = {n[0], n[1], n[2]};
+        neighborStarts[ix + 1] = oMesh.valence(vh);
+      } });
+    for (size_t ix = 0; ix < numVertices; ++ix)
+      neighborStarts[ix + 1] += neighborStarts[ix];
+
+    neighborIdxs.resize(neighborStarts[numVertices]);
+    ws::forEachChunk(threadPool, numVertices, chunkSize, [&](size_t, size_t begin, size_t end)
+                     {
+      for (size_t ix = begin; ix < end; ++ix)
+      {
+        uint32_t k = neighborStarts[ix];
+        for (auto vv_it = oMesh.cvv_cwiter(ws::OMesh::VertexHandle{static_cast<int>(ix)}); vv_it.is_valid(); ++vv_it)
+          neighborIdxs[k++] = static_cast<uint32_t>(vv_it->idx());
+      } });
+  }
+
+  glm::vec3 newCellPosition(const MeshSnapshot &snapshot, uint32_t vIx, const ws::PointGrid &grid)
   {
-    const ws::OMesh::VertexHandle vh{vIx};
-    const ws::OMesh::Point pp = oMesh.point(vh);
-    glm::vec3 vp{pp[0], pp[1], pp[2]};
+    glm::vec3 vp = snapshot.positions[vIx];
 
     glm::vec3 springTarget = {};
     glm::vec3 planarTarget = {};
     glm::vec3 collisionOffset = {};
 
     float bulgeDist = 0.0f;
-    const ws::OMesh::Normal np = oMesh.calc_normal(vh);
-    glm::vec3 normal{np[0], np[1], np[2]};
-    uint32_t numNeighbors = 0;
-    for (auto vv_it = oMesh.cvv_cwiter(vh); vv_it.is_valid(); ++vv_it)
+    const glm::vec3 normal = snapshot.normals[vIx];
+    const uint32_t neighborsBegin = snapshot.neighborStarts[vIx];
+    const uint32_t neighborsEnd = snapshot.neighborStarts[vIx + 1];
+    const uint32_t numNeighbors = neighborsEnd - neighborsBegin;
+    const float rSqr = parameters.linkRestLength * parameters.linkRestLength;
+    for (uint32_t k = neighborsBegin; k < neighborsEnd; ++k)
     {
-      ++numNeighbors;
-      const ws::OMesh::Point qp = oMesh.point(*vv_it);
-      glm::vec3 q{qp[0], qp[1], qp[2]};
+      const glm::vec3 q = snapshot.positions[snapshot.neighborIdxs[k]];
       glm::vec3 d = q - vp;
       springTarget += q + parameters.linkRestLength * -glm::normalize(d);
       planarTarget += q;
 
       float dSqr = glm::length2(d);
-      float rSqr = parameters.linkRestLength * parameters.linkRestLength;
       if (dSqr < rSqr) // can't push if too far away
       {
         float dot = glm::dot(d, normal);
@@ -44,28 +79,13 @@ namespace cellular
     }
     float roi2 = parameters.radiusOfInfluence * parameters.radiusOfInfluence;
 
-    auto p = oMesh.points();
-    const int numPoints = oMesh.n_vertices();
-    for (int i = 0; i < numPoints; ++i)
-    {
-
-      // for (auto uh : oMesh.vertices())
-      // {
-      const ws::OMesh::Point upp = *p;
-
-      // const ws::OMesh::Point upp = oMesh.point(uh);
-      glm::vec3 up{upp[0], upp[1], upp[2]};
-
-      // if (uh.idx() == vh.idx() || oMesh.find_halfedge(vh, uh).is_valid() || glm::length2(up - vp) > roi2)
-      if (glm::length(up - vp) < 0.01 || glm::length2(up - vp) > roi2)
-      {
-        continue;
-      }
-      glm::vec3 d = vp - up;
-      collisionOffset += (1 - glm::length2(d) / roi2) * glm::normalize(d);
-
-      p++;
-    }
+    grid.forEachWithin(vp, parameters.radiusOfInfluence, [&](uint32_t, const glm::vec3 &up)
+                       {
+                         // itself, or a point at the same place which doesn't push in any direction
+                         if (glm::length(up - vp) < 0.01)
+                           return;
+                         glm::vec3 d = vp - up;
+                         collisionOffset += (1 - glm::length2(d) / roi2) * glm::normalize(d); });
     springTarget /= numNeighbors;
     planarTarget /= numNeighbors;
     glm::vec3 bulgeTarget = vp + normal * (bulgeDist / numNeighbors);
@@ -74,12 +94,21 @@ namespace cellular
     return vp;
   }
 
-  void updateCellPositions(ws::OMesh &oMesh)
+  void updateCellPositions(ws::OMesh &oMesh, ws::ThreadPool *threadPool)
   {
-    std::vector<glm::vec3> newPositions{oMesh.n_vertices()};
-
-    for (const auto &vh : oMesh.vertices())
-      newPositions[vh.idx()] = newCellPosition(oMesh, vh.idx());
+    MeshSnapshot snapshot;
+    snapshot.capture(oMesh, threadPool);
+    // built once per step, instead of every cell scanning all points for the ones that repel it
+    ws::PointGrid grid;
+    grid.rebuild(snapshot.positions.size(), parameters.radiusOfInfluence, [&snapshot](size_t ix)
+                 { return snapshot.positions[ix]; });
+
+    // cells read the snapshot and write their own entry, the order in which they run doesn't matter
+    std::vector<glm::vec3> newPositions(snapshot.positions.size());
+    ws::forEachChunk(threadPool, newPositions.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                     {
+      for (size_t ix = begin; ix < end; ++ix)
+        newPositions[ix] = newCellPosition(snapshot, static_cast<uint32_t>(ix), grid); });
 
     for (auto &vh : oMesh.vertices())
     {
@@ -1,5 +1,12 @@
 #pragma once
 #include <OMesh.h>
+#include <PointGrid.h>
+#include <ThreadPool.h>
+
+#include <glm/vec3.hpp>
+
+#include <cstdint>
+#include <vector>
 
 namespace cellular
 {
@@ -15,7 +22,22 @@ namespace cellular
 
   extern Parameters parameters;
 
-  glm::vec3 newCellPosition(ws::OMesh &oMesh, int32_t vIx);
+  // Flat copy of the mesh taken once per step, so that cells can be updated in parallel without touching OpenMesh.
+  // Neighbors of vertex v are neighborIdxs[neighborStarts[v] .. neighborStarts[v + 1]), in clockwise order.
+  struct MeshSnapshot
+  {
+    std::vector<glm::vec3> positions;
+    std::vector<glm::vec3> normals;
+    std::vector<uint32_t> neighborStarts;
+    std::vector<uint32_t> neighborIdxs;
+
+    // threadPool can be null, then everything runs on the calling thread
+    void capture(const ws::OMesh &oMesh, ws::ThreadPool *threadPool);
+  };
+
+  // grid holds the snapshot's positions, its queries within radiusOfInfluence find the cells that repel this one
+  glm::vec3 newCellPosition(const MeshSnapshot &snapshot, uint32_t vIx, const ws::PointGrid &grid);
 
-  void updateCellPositions(ws::OMesh &oMesh);
+  // Cells are updated in parallel on threadPool, or serially if it is null. Results don't depend on the number of threads.
+  void updateCellPositions(ws::OMesh &oMesh, ws::ThreadPool *threadPool = nullptr);
 }
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include <Mesh.h>
 #include <OMesh.h>
 #include <Camera.h>
+#include <ThreadPool.h>
 
 #include <glad/gl.h>
 #include <imgui.h>
@@ -26,6 +27,8 @@ public:
   std::unique_ptr<ws::Mesh> mesh;
   std::unique_ptr<ws::Mesh> meshSelectionViz;
   std::unique_ptr<ws::CameraPerspective> camera;
+  // cells are updated in parallel on it
+  std::unique_ptr<ws::ThreadPool> threadPool;
   std::mt19937 rng;
   std::uniform_real_distribution<float> dist;
 
@@ -35,6 +38,7 @@ public:
   {
     rng = std::mt19937{std::random_device{}()};
     dist = std::uniform_real_distribution<float>();
+    threadPool = std::make_unique<ws::ThreadPool>();
 
     const char *mainShaderVertex = R"(
 #version 460 core
@@ -215,7 +219,7 @@ void main()
     // Simulation
     if (ImGui::Button("Update Positions!"))
     {
-      cellular::updateCellPositions(*oMesh);
+      cellular::updateCellPositions(*oMesh, threadPool.get());
       ws::updateMeshFromOMesh(*mesh, *oMesh);
     }
     static bool shouldUpdatePositionsEveryFrame = false;
@@ -223,7 +227,7 @@ void main()
     ImGui::Separator();
     if (shouldUpdatePositionsEveryFrame)
     {
-      cellular::updateCellPositions(*oMesh);
+      cellular::updateCellPositions(*oMesh, threadPool.get());
       ws::updateMeshFromOMesh(*mesh, *oMesh);
     }
 
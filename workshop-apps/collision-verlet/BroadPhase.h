@@ -0,0 +1,188 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+// Broad phases find the pairs of objects that may overlap, so that the collision constraint is not tested on all
+// O(n^2) pairs. Both call a function for every candidate pair (i, j) once per rebuild, the function does the exact test.
+
+// Uniform grid over the bounding box of the objects with cells at least as large as the largest diameter.
+// Then objects can only touch objects of their own or the 8 surrounding cells. Rebuilt from scratch by a counting
+// sort of the objects into cells, linear in the number of objects and cells.
+class UniformGrid
+{
+public:
+  // beyond this the cells are made larger than needed, which keeps memory and the counting sort's cost bounded
+  static constexpr int maxCellsPerAxis = 1024;
+
+  float cellSize{};
+  glm::vec2 origin{};
+  int numCellsX{};
+  int numCellsY{};
+
+  std::vector<int32_t> cellOfObject;
+  std::vector<int32_t> cellStarts;
+  std::vector<int32_t> objIdxs;
+  // whether a cell has an object that is awake. Pairs of cells without one are skipped, sleepers don't collide.
+  std::vector<uint8_t> cellIsAwake;
+
+  void rebuild(const std::vector<VerletObject> &objects)
+  {
+    if (objects.empty())
+    {
+      numCellsX = numCellsY = 0;
+      return;
+    }
+    glm::vec2 minPos = objects[0].position_current;
+    glm::vec2 maxPos = minPos;
+    float maxRadius = 0.0f;
+    for (const auto &obj : objects)
+    {
+      minPos = glm::min(minPos, obj.position_current);
+      maxPos = glm::max(maxPos, obj.position_current);
+      maxRadius = std::max(maxRadius, obj.radius);
+    }
+    const glm::vec2 extent = maxPos - minPos;
+    cellSize = std::max({2.0f * maxRadius, extent.x / maxCellsPerAxis, extent.y / maxCellsPerAxis, 1e-6f});
+    origin = minPos;
+    numCellsX = std::min(static_cast<int>(extent.x / cellSize) + 1, maxCellsPerAxis);
+    numCellsY = std::min(static_cast<int>(extent.y / cellSize) + 1, maxCellsPerAxis);
+    const size_t numCells = static_cast<size_t>(numCellsX) * numCellsY;
+
+    // count objects per cell, shifted by one so that the prefix sum below turns counts into starts
+    cellOfObject.resize(objects.size());
+    cellStarts.assign(numCells + 1, 0);
+    cellIsAwake.assign(numCells, 0);
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+    {
+      cellOfObject[ix] = cellIndexOf(objects[ix].position_current);
+      ++cellStarts[cellOfObject[ix] + 1];
+      cellIsAwake[cellOfObject[ix]] |= !objects[ix].isAsleep;
+    }
+    for (size_t c = 0; c < numCells; ++c)
+      cellStarts[c + 1] += cellStarts[c];
+
+    // stable scatter, objects keep their relative order within a cell
+    cellCursors.assign(cellStarts.begin(), cellStarts.end() - 1);
+    objIdxs.resize(objects.size());
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+      objIdxs[cellCursors[cellOfObject[ix]]++] = static_cast<int32_t>(ix);
+  }
+
+  int32_t cellIndexOf(const glm::vec2 &pos) const
+  {
+    const int i = std::clamp(static_cast<int>((pos.x - origin.x) / cellSize), 0, numCellsX - 1);
+    const int j = std::clamp(static_cast<int>((pos.y - origin.y) / cellSize), 0, numCellsY - 1);
+    return j * numCellsX + i;
+  }
+
+  // Pairs of objects in cell (i, j) and in it or the next cells, visiting half of the 3x3 neighborhood so that each
+  // pair of cells comes up once
+  template <typename Fn>
+  void forEachPairOfCell(int i, int j, Fn &&fn) const
+  {
+    const int32_t c = j * numCellsX + i;
+    if (cellIsAwake[c])
+      for (int32_t a = cellStarts[c]; a < cellStarts[c + 1]; ++a)
+        for (int32_t b = a + 1; b < cellStarts[c + 1]; ++b)
+          fn(objIdxs[a], objIdxs[b]);
+
+    static constexpr int neighborOffsets[4][2] = {{1, 0}, {-1, 1}, {0, 1}, {1, 1}};
+    for (const auto &[di, dj] : neighborOffsets)
+    {
+      const int ni = i + di;
+      const int nj = j + dj;
+      if (ni < 0 || ni >= numCellsX || nj >= numCellsY)
+        continue;
+      const int32_t n = nj * numCellsX + ni;
+      if (!cellIsAwake[c] && !cellIsAwake[n])
+        continue;
+      for (int32_t a = cellStarts[c]; a < cellStarts[c + 1]; ++a)
+        for (int32_t b = cellStarts[n]; b < cellStarts[n + 1]; ++b)
+          fn(objIdxs[a], objIdxs[b]);
+    }
+  }
+
+  template <typename Fn>
+  void forEachPair(Fn &&fn) const
+  {
+    for (int j = 0; j < numCellsY; ++j)
+      for (int i = 0; i < numCellsX; ++i)
+        forEachPairOfCell(i, j, fn);
+  }
+
+private:
+  // write positions of the counting sort's scatter, kept to reuse its allocation
+  std::vector<int32_t> cellCursors;
+};
+
+// Sweep and prune along x: objects sorted by the left end of their extent, each is tested against the following ones
+// until those start right of its right end. Unlike the grid it doesn't care how much radii vary, one large object
+// doesn't make the cells of all small ones large. The order is kept between rebuilds, objects move little in a step,
+// so an insertion sort has almost nothing to do.
+class SweepAndPrune
+{
+public:
+  std::vector<int32_t> order;
+
+  void rebuild(const std::vector<VerletObject> &objects)
+  {
+    // objects are appended, new ones go to the end and are sorted in. Start over if objects were removed.
+    if (order.size() > objects.size())
+      order.clear();
+    for (size_t ix = order.size(); ix < objects.size(); ++ix)
+      order.push_back(static_cast<int32_t>(ix));
+
+    minX.resize(objects.size());
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+      minX[ix] = objects[ix].position_current.x - objects[ix].radius;
+    for (size_t k = 1; k < order.size(); ++k)
+    {
+      const int32_t ix = order[k];
+      size_t m = k;
+      for (; m > 0 && minX[order[m - 1]] > minX[ix]; --m)
+        order[m] = order[m - 1];
+      order[m] = ix;
+    }
+  }
+
+  // Objects were permuted, object old is now remap[old]. Keeps the sorted order, unlike starting over.
+  void remapObjects(const std::vector<uint32_t> &remap)
+  {
+    if (order.size() > remap.size())
+      order.clear();
+    for (int32_t &ix : order)
+      ix = static_cast<int32_t>(remap[ix]);
+  }
+
+  // Objects from count on were removed, the order of the rest stays sorted
+  void truncate(size_t count)
+  {
+    std::erase_if(order, [count](int32_t ix)
+                  { return static_cast<size_t>(ix) >= count; });
+  }
+
+  // Extents are those of the rebuild, objects moved by fn are not re-sorted until the next one. A margin widens the
+  // extents to the right, for pairs that are up to margin apart along x.
+  template <typename Fn>
+  void forEachPair(const std::vector<VerletObject> &objects, Fn &&fn, float margin = 0.0f) const
+  {
+    for (size_t k = 0; k < order.size(); ++k)
+    {
+      const VerletObject &o1 = objects[order[k]];
+      const float maxX = minX[order[k]] + 2.0f * o1.radius + margin;
+      for (size_t m = k + 1; m < order.size() && minX[order[m]] <= maxX; ++m)
+        fn(order[k], order[m]);
+    }
+  }
+
+private:
+  // left ends of the objects' extents, by object index
+  std::vector<float> minX;
+};
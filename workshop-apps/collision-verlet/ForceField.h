@@ -0,0 +1,70 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <glm/vec2.hpp>
+
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+// Accelerations acting on all objects, independent of their mass: uniform gravity plus any number of radial attractors
+// and vortices. Evaluated for a range of objects at once, one field after the other, each as a plain loop over objects.
+struct ForceField
+{
+  // Pulls towards center with strength / r^2, Plummer-softened within about softening of it. Negative strength repels.
+  struct Attractor
+  {
+    glm::vec2 center{};
+    float strength = 1.0f;
+    float softening = 0.05f;
+
+    bool operator==(const Attractor &) const = default;
+  };
+
+  // Swirls counter-clockwise around center, positive strength, with a tangential acceleration of
+  // strength * r / radius * exp(-r^2 / radius^2): zero at the center, largest at radius / sqrt(2), fading beyond
+  struct Vortex
+  {
+    glm::vec2 center{};
+    float strength = 1.0f;
+    float radius = 0.3f;
+
+    bool operator==(const Vortex &) const = default;
+  };
+
+  glm::vec2 gravity{0.0f, -1.0f};
+  std::vector<Attractor> attractors;
+  std::vector<Vortex> vortices;
+
+  bool operator==(const ForceField &) const = default;
+
+  // acc[ix] for objects [begin, end)
+  void accelerations(const std::vector<VerletObject> &objects, std::vector<glm::vec2> &acc, size_t begin, size_t end) const
+  {
+    for (size_t ix = begin; ix < end; ++ix)
+      acc[ix] = gravity;
+
+    for (const Attractor &a : attractors)
+    {
+      const float soft2 = a.softening * a.softening;
+      for (size_t ix = begin; ix < end; ++ix)
+      {
+        const glm::vec2 r = a.center - objects[ix].position_current;
+        const float r2 = glm::dot(r, r) + soft2;
+        acc[ix] += r * (a.strength / (r2 * std::sqrt(r2)));
+      }
+    }
+
+    for (const Vortex &v : vortices)
+    {
+      const float invRadius2 = 1.0f / (v.radius * v.radius);
+      for (size_t ix = begin; ix < end; ++ix)
+      {
+        const glm::vec2 r = objects[ix].position_current - v.center;
+        const glm::vec2 tangent{-r.y, r.x};
+        acc[ix] += tangent * (v.strength / v.radius * std::exp(-glm::dot(r, r) * invRadius2));
+      }
+    }
+  }
+};
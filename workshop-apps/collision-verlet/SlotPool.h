@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Fixed number of slots, e.g. of a renderer's buffers, handed out to objects for as long as they live. Released slots
+// go to a free list and are handed out again before any unused one, so slots in use stay below the high-water mark
+// and buffers sized for the capacity never need to grow.
+class SlotPool
+{
+public:
+  explicit SlotPool(size_t capacity)
+      : capacity{capacity}
+  {
+    freeSlots.reserve(capacity);
+  }
+
+  const size_t capacity;
+
+  bool isFull() const { return numInUse == capacity; }
+  size_t getNumInUse() const { return numInUse; }
+  // slots ever handed out are in [0, highWaterMark)
+  uint32_t getHighWaterMark() const { return highWaterMark; }
+
+  // The pool must not be full
+  uint32_t acquire()
+  {
+    ++numInUse;
+    if (!freeSlots.empty())
+    {
+      const uint32_t slot = freeSlots.back();
+      freeSlots.pop_back();
+      return slot;
+    }
+    return highWaterMark++;
+  }
+
+  void release(uint32_t slot)
+  {
+    freeSlots.push_back(slot);
+    --numInUse;
+  }
+
+private:
+  std::vector<uint32_t> freeSlots;
+  size_t numInUse{};
+  uint32_t highWaterMark{};
+};
@@ -0,0 +1,341 @@
+#pragma once
+
+#include "BroadPhase.h"
+#include "ForceField.h"
+#include "VerletObject.h"
+
+#include <MortonOrder.h>
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <vector>
+
+class Solver
+{
+public:
+  enum class BroadPhase
+  {
+    AllPairs,
+    UniformGrid,
+    SweepAndPrune,
+  };
+
+  std::vector<VerletObject> &objects;
+  BroadPhase broadPhase = BroadPhase::UniformGrid;
+  UniformGrid grid;
+  SweepAndPrune sweepAndPrune;
+  ForceField forceField;
+  // an update is split into this many steps, each resolves collisions numIterations times then integrates
+  int numSubsteps = 1;
+  int numIterations = 1;
+  // Runs integration and the grid's collisions in parallel when set, serially when nullptr.
+  // Grid cells are resolved in 9 colors (i mod 3, j mod 3), one color after the other. Resolving a cell moves objects
+  // of it and of its neighbors only, cells of a color are 3 apart, hence their objects are disjoint and they run
+  // concurrently without races. The order of pairs within a cell is fixed, results are identical for any number of threads.
+  // All Pairs and Sweep and Prune stay serial.
+  ws::ThreadPool *threadPool = nullptr;
+  static constexpr size_t chunkSize = 256;
+  static constexpr size_t cellChunkSize = 64;
+  // duration of the collision constraint in the last update, all substeps and iterations
+  float collisionMs{};
+  // duration of updateSleeping() in the last update
+  float sleepingMs{};
+  // Objects whose motion, their squared speed over whole updates averaged over about motionTimeConstant seconds, is
+  // below sleepSpeed^2 are resting. Over whole updates, so that jitter between substeps cancels. Resting objects that
+  // touch no moving object fall asleep, in islands of touching ones, see updateSleeping(). Once everything sleeps an
+  // update costs nothing. An object faster than twice sleepSpeed touching a sleeper wakes its island, slower ones
+  // bounce off it as off a wall. Changing forceField wakes everything.
+  bool allowSleeping = true;
+  float sleepSpeed = 0.05f;
+  float motionTimeConstant = 0.25f;
+  size_t numAsleep{};
+
+  Solver(std::vector<VerletObject> &objects) : objects(objects) {}
+
+  void update(float dt)
+  {
+    const float substepDt = dt / static_cast<float>(numSubsteps);
+    collisionMs = 0.0f;
+    sleepingMs = 0.0f;
+    if ((!allowSleeping && numAsleep > 0) || forceField != sleepingForceField)
+    {
+      wakeAll();
+      sleepingForceField = forceField;
+    }
+    if (numAsleep > 0 && numAsleep == objects.size())
+      return;
+    updateStartPositions.resize(objects.size());
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+      updateStartPositions[ix] = objects[ix].position_current;
+    for (int substep = 0; substep < numSubsteps; ++substep)
+    {
+      // collision constraint
+      const auto start = std::chrono::steady_clock::now();
+      const auto resolve = [this](int32_t i, int32_t j)
+      { resolvePair(objects[i], objects[j]); };
+      switch (broadPhase)
+      {
+      case BroadPhase::AllPairs:
+        for (int iteration = 0; iteration < numIterations; ++iteration)
+          for (size_t i = 0; i < objects.size(); ++i)
+            for (size_t j = i + 1; j < objects.size(); ++j)
+              resolvePair(objects[i], objects[j]);
+        break;
+      case BroadPhase::UniformGrid:
+        // objects move less than a cell per substep, later iterations test the same candidates
+        grid.rebuild(objects);
+        for (int iteration = 0; iteration < numIterations; ++iteration)
+          resolveGridInColors();
+        break;
+      case BroadPhase::SweepAndPrune:
+        sweepAndPrune.rebuild(objects);
+        for (int iteration = 0; iteration < numIterations; ++iteration)
+          sweepAndPrune.forEachPair(objects, resolve);
+        break;
+      }
+      const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+      collisionMs += duration.count();
+
+      accelerations.resize(objects.size());
+      ws::forEachChunk(threadPool, objects.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                       {
+        forceField.accelerations(objects, accelerations, begin, end);
+        for (size_t ix = begin; ix < end; ++ix)
+          if (!objects[ix].isAsleep)
+            objects[ix].updatePosition(substepDt, accelerations[ix]); });
+    }
+
+    const float blend = std::min(dt / motionTimeConstant, 1.0f);
+    ws::forEachChunk(threadPool, objects.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                     {
+      for (size_t ix = begin; ix < end; ++ix)
+      {
+        VerletObject &obj = objects[ix];
+        const glm::vec2 disp = obj.position_current - updateStartPositions[ix];
+        obj.motion += (glm::dot(disp, disp) / (dt * dt) - obj.motion) * blend;
+      } });
+    if (allowSleeping)
+    {
+      const auto start = std::chrono::steady_clock::now();
+      updateSleeping();
+      const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+      sleepingMs = duration.count();
+    }
+  }
+
+  void wakeAll()
+  {
+    for (VerletObject &obj : objects)
+      wake(obj);
+    numAsleep = 0;
+  }
+
+  // Removes the objects from count on. Everything is woken, a removed ball can leave a hole under a sleeping pile,
+  // and island labels must stay below the number of objects.
+  void truncate(size_t count)
+  {
+    if (count >= objects.size())
+      return;
+    objects.resize(count);
+    sweepAndPrune.truncate(count);
+    wakeAll();
+  }
+
+  // Sorts objects along a Z-order curve, so that the objects of a grid cell and of its neighbors are close in memory.
+  // Spawn order scatters them, which makes the collision passes miss the cache. Sweep and Prune's order follows the
+  // objects. Returns remap[old index] = new index for arrays parallel to objects, see ws::permuteByRemap().
+  const std::vector<uint32_t> &reorderMorton()
+  {
+    mortonOrder.compute(objects.size(), [this](size_t ix)
+                        { return objects[ix].position_current; });
+    ws::permuteByRemap(objects, mortonOrder.remap);
+    sweepAndPrune.remapObjects(mortonOrder.remap);
+    return mortonOrder.remap;
+  }
+
+private:
+  ws::MortonOrder mortonOrder;
+  // positions at the start of the update, for measuring motion
+  std::vector<glm::vec2> updateStartPositions;
+  // forceField when objects went to sleep
+  ForceField sleepingForceField;
+  // per island whether a member was woken by a contact and its first member, union-find parents and flags of
+  // updateSleeping(). Labels of islands are indices of objects, hence smaller than the number of objects.
+  std::vector<uint8_t> islandWoken;
+  std::vector<int32_t> islandFirst;
+  std::vector<uint32_t> islandParents;
+  std::vector<uint8_t> touchesMoving;
+
+  // Woken objects count as barely moving, they fall asleep again soon if nothing pushes them
+  void wake(VerletObject &obj) const
+  {
+    obj.isAsleep = false;
+    obj.island = -1;
+    obj.motion = 2.0f * sleepSpeed * sleepSpeed;
+  }
+
+  bool isResting(const VerletObject &obj) const { return obj.isAsleep || obj.motion < sleepSpeed * sleepSpeed; }
+
+  // Collision of a pair that may involve sleepers, which don't move. Touched by a fast object a sleeper wakes up, the
+  // margin between sleeping and waking keeps objects jittering around sleepSpeed from waking their neighbors all the
+  // time. Only the woken object moves in this pass, its island follows at the end of the update.
+  void resolvePair(VerletObject &o1, VerletObject &o2) const
+  {
+    if (!o1.isAsleep && !o2.isAsleep)
+      resolveCollision(o1, o2);
+    else if (!o1.isAsleep || !o2.isAsleep)
+    {
+      VerletObject &awake = o1.isAsleep ? o2 : o1;
+      VerletObject &sleeper = o1.isAsleep ? o1 : o2;
+      if (resolveCollision(awake, sleeper, 1.0f) && awake.motion > 4.0f * sleepSpeed * sleepSpeed)
+        sleeper.isAsleep = false;
+    }
+  }
+
+  // Wakes the islands of objects woken by contacts, then puts resting objects that touch no moving object to sleep.
+  // Islands are the connected components of resting objects touching within a margin, found by union-find. Members of
+  // an island are joined through its label, so the grid only needs a pass over its cells with awake objects. Contacts
+  // are the candidates of the active broad phase from the last substep, see forEachContactCandidate(). Runs the pass
+  // only while there are resting awake objects.
+  void updateSleeping()
+  {
+    const size_t n = objects.size();
+    bool anyWoken = false;
+    islandWoken.assign(n, 0);
+    for (VerletObject &obj : objects)
+      if (!obj.isAsleep && obj.island >= 0)
+      {
+        islandWoken[obj.island] = 1;
+        wake(obj);
+        anyWoken = true;
+      }
+    if (anyWoken)
+      for (VerletObject &obj : objects)
+        if (obj.isAsleep && islandWoken[obj.island])
+          wake(obj);
+
+    const auto isCandidate = [this](const VerletObject &obj)
+    { return !obj.isAsleep && isResting(obj); };
+    if (std::none_of(objects.begin(), objects.end(), isCandidate))
+    {
+      numAsleep = std::count_if(objects.begin(), objects.end(), [](const VerletObject &obj)
+                                { return obj.isAsleep; });
+      return;
+    }
+
+    islandParents.resize(n);
+    std::iota(islandParents.begin(), islandParents.end(), 0u);
+    const auto findRoot = [&](uint32_t ix)
+    {
+      while (islandParents[ix] != ix)
+      {
+        islandParents[ix] = islandParents[islandParents[ix]];
+        ix = islandParents[ix];
+      }
+      return ix;
+    };
+    islandFirst.assign(n, -1);
+    for (uint32_t ix = 0; ix < n; ++ix)
+    {
+      const VerletObject &obj = objects[ix];
+      if (!obj.isAsleep)
+        continue;
+      if (islandFirst[obj.island] < 0)
+        islandFirst[obj.island] = static_cast<int32_t>(ix);
+      else
+        islandParents[ix] = static_cast<uint32_t>(islandFirst[obj.island]);
+    }
+    touchesMoving.assign(n, 0);
+    forEachContactCandidate(anyWoken, [&](int32_t i, int32_t j)
+                            {
+      const VerletObject &o1 = objects[i];
+      const VerletObject &o2 = objects[j];
+      const glm::vec2 disp = o1.position_current - o2.position_current;
+      // resting contacts are slightly apart after the last integration
+      const float reach = 1.1f * (o1.radius + o2.radius);
+      if (glm::dot(disp, disp) >= reach * reach)
+        return;
+      const bool isResting1 = isResting(o1);
+      const bool isResting2 = isResting(o2);
+      if (isResting1 && isResting2)
+        islandParents[findRoot(i)] = findRoot(j);
+      else if (isResting1)
+        touchesMoving[i] = 1;
+      else if (isResting2)
+        touchesMoving[j] = 1; });
+    numAsleep = 0;
+    for (uint32_t ix = 0; ix < n; ++ix)
+    {
+      VerletObject &obj = objects[ix];
+      // sleepers touching a moving object stay asleep, but take the label of their island
+      if (obj.isAsleep || (isResting(obj) && !touchesMoving[ix]))
+      {
+        if (!obj.isAsleep)
+          obj.position_old = obj.position_current;
+        obj.isAsleep = true;
+        obj.island = static_cast<int32_t>(findRoot(ix));
+      }
+      numAsleep += obj.isAsleep;
+    }
+  }
+
+  // Candidate pairs of the active broad phase as built for the last substep's collision pass, a superset of the resting
+  // contacts since resting objects moved very little after it. The grid skips pairs of cells it saw asleep, it's
+  // rebuilt only if islands were woken since. Sweep and prune extents are widened by the contact margin.
+  template <typename Fn>
+  void forEachContactCandidate(bool anyWoken, Fn &&fn)
+  {
+    switch (broadPhase)
+    {
+    case BroadPhase::AllPairs:
+      for (size_t i = 0; i < objects.size(); ++i)
+        for (size_t j = i + 1; j < objects.size(); ++j)
+          fn(static_cast<int32_t>(i), static_cast<int32_t>(j));
+      break;
+    case BroadPhase::UniformGrid:
+      if (anyWoken)
+        grid.rebuild(objects);
+      grid.forEachPair(fn);
+      break;
+    case BroadPhase::SweepAndPrune:
+    {
+      float maxRadius = 0.0f;
+      for (const VerletObject &obj : objects)
+        maxRadius = std::max(maxRadius, obj.radius);
+      sweepAndPrune.forEachPair(objects, fn, 0.2f * maxRadius);
+      break;
+    }
+    }
+  }
+
+  // of the field at the objects' positions, per substep
+  std::vector<glm::vec2> accelerations;
+
+  void resolveGridInColors()
+  {
+    const auto resolve = [this](int32_t i, int32_t j)
+    { resolvePair(objects[i], objects[j]); };
+    // cells of color (ci, cj) are (ci + 3a, cj + 3b)
+    const int numColorCellsX = (grid.numCellsX + 2) / 3;
+    const int numColorCellsY = (grid.numCellsY + 2) / 3;
+    const size_t numColorCells = static_cast<size_t>(numColorCellsX) * numColorCellsY;
+    for (int color = 0; color < 9; ++color)
+    {
+      const int ci = color % 3;
+      const int cj = color / 3;
+      ws::forEachChunk(threadPool, numColorCells, cellChunkSize, [&](size_t, size_t begin, size_t end)
+                       {
+        for (size_t k = begin; k < end; ++k)
+        {
+          const int i = ci + 3 * static_cast<int>(k % numColorCellsX);
+          const int j = cj + 3 * static_cast<int>(k / numColorCellsX);
+          if (i < grid.numCellsX && j < grid.numCellsY)
+            grid.forEachPairOfCell(i, j, resolve);
+        } });
+    }
+  }
+};
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+
+#include <cmath>
+#include <cstdint>
+#include <type_traits>
+
+// Forces come from the solver's ForceField, evaluated for all objects in one pass, objects only carry their state
+struct VerletObject
+{
+  glm::vec2 position_current{};
+  glm::vec2 position_old{};
+  float mass = 1.0f;
+  float radius = 0.1f;
+  // moving average of the squared speed, see Solver::sleepSpeed. New objects start out as moving.
+  float motion = 1.0f;
+  // Island of resting objects it went to sleep with, see Solver::updateSleeping(). Sleeping objects are neither
+  // integrated nor pushed. An object woken by a contact keeps the island until the solver wakes the rest of it, -1 otherwise.
+  int32_t island = -1;
+  bool isAsleep = false;
+
+  // acc: acceleration at position_current
+  void updatePosition(float dt, const glm::vec2 &acc)
+  {
+    // apply boundry constraint
+    const glm::vec2 center = {0, 0};
+    const float border = 1.0f;
+    const glm::vec2 relPos = position_current - center;
+    const float dist = glm::length(relPos);
+    if (dist > border - radius)
+    {
+      const glm::vec2 n = relPos / dist;
+      position_current = center + n * (border - radius);
+
+      // might need to update position_old if change in position_current is big.
+    }
+
+    // update position
+    const glm::vec2 velocity = position_current - position_old;
+    position_old = position_current;
+    // position-Verlet
+    position_current = position_current + velocity + acc * dt * dt;
+  }
+};
+static_assert(std::is_trivially_copyable_v<VerletObject> && sizeof(VerletObject) <= 64);
+
+// Pushes two overlapping objects apart along the line between their centers, o1 by share1 of the overlap and o2 by the
+// rest. Returns whether they overlapped.
+inline bool resolveCollision(VerletObject &o1, VerletObject &o2, float share1 = 0.5f)
+{
+  const glm::vec2 disp = o1.position_current - o2.position_current;
+  const float minDist = o1.radius + o2.radius;
+  const float dist2 = glm::dot(disp, disp);
+  // the square root is only needed for the pairs that actually touch
+  if (dist2 >= minDist * minDist || dist2 == 0.0f)
+    return false;
+  const float dist = std::sqrt(dist2);
+  const float delta = dist - minDist;
+  const glm::vec2 n = disp / dist;
+  o1.position_current -= share1 * delta * n;
+  o2.position_current += (1.0f - share1) * delta * n;
+  return true;
+}
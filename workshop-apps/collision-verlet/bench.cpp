@@ -0,0 +1,227 @@
+// Headless benchmark of the collision-verlet solver. Packs n balls into the lower part of the container, lets them
+// settle into a pile, then times updates of the pile with each requested broad phase and prints the results as JSON to
+// stdout. No window, OpenGL or ImGui involved.
+//
+// usage: collision-verlet-bench [--n 50000] [--radius 0] [--broad-phase grid|sap|all-pairs|all] [--threads 1]
+//                               [--substeps 8] [--iterations 1] [--settle 300] [--steps 60] [--seed 0]
+//                               [--shuffle] [--reorder-every 0] [--sleeping] [--sleep-warmup 120]
+// An update is one Solver::update() of 1/60 s, like one frame of the app. --radius 0 picks the radius at which the
+// balls fill about half of the container. Settling uses the uniform grid and isn't timed, all broad phases start from
+// the same settled pile. --shuffle scatters the settled balls in memory, as spawning them one by one does. With
+// --reorder-every R > 0 they are sorted along a Z-order curve before the first and after every R timed updates,
+// included in the timings, see Solver::reorderMorton(). --sleeping times every broad phase twice, with sleeping off
+// and on. Both runs first take --sleep-warmup untimed updates, in which the resting balls of the second fall asleep.
+#include "Verlet.h"
+
+#include <ThreadPool.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+namespace
+{
+  struct Options
+  {
+    int n = 50000;
+    float radius = 0.0f;
+    std::string broadPhase = "grid";
+    int threads = 1;
+    int substeps = 8;
+    int iterations = 1;
+    int settle = 300;
+    int steps = 60;
+    unsigned seed = 0;
+    bool shuffle = false;
+    int reorderEvery = 0;
+    bool sleeping = false;
+    int sleepWarmup = 120;
+  };
+
+  constexpr float dt = 1.0f / 60.0f;
+
+  bool parseOptions(int argc, char **argv, Options &opt)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      if (arg == "--shuffle")
+      {
+        opt.shuffle = true;
+        continue;
+      }
+      if (arg == "--sleeping")
+      {
+        opt.sleeping = true;
+        continue;
+      }
+      const char *value = i + 1 < argc ? argv[++i] : nullptr;
+      if (value == nullptr)
+        return false;
+      else if (arg == "--n")
+        opt.n = std::atoi(value);
+      else if (arg == "--radius")
+        opt.radius = static_cast<float>(std::atof(value));
+      else if (arg == "--broad-phase")
+        opt.broadPhase = value;
+      else if (arg == "--threads")
+        opt.threads = std::atoi(value);
+      else if (arg == "--substeps")
+        opt.substeps = std::atoi(value);
+      else if (arg == "--iterations")
+        opt.iterations = std::atoi(value);
+      else if (arg == "--settle")
+        opt.settle = std::atoi(value);
+      else if (arg == "--steps")
+        opt.steps = std::atoi(value);
+      else if (arg == "--seed")
+        opt.seed = static_cast<unsigned>(std::atoi(value));
+      else if (arg == "--reorder-every")
+        opt.reorderEvery = std::atoi(value);
+      else if (arg == "--sleep-warmup")
+        opt.sleepWarmup = std::atoi(value);
+      else
+        return false;
+    }
+    return opt.n > 0 && opt.radius >= 0.0f && opt.threads > 0 && opt.substeps > 0 && opt.iterations > 0 &&
+           opt.settle >= 0 && opt.steps > 0 && opt.reorderEvery >= 0 && opt.sleepWarmup >= 0 &&
+           (opt.broadPhase == "grid" || opt.broadPhase == "sap" || opt.broadPhase == "all-pairs" || opt.broadPhase == "all");
+  }
+
+  struct BroadPhaseRun
+  {
+    const char *name;
+    Solver::BroadPhase broadPhase;
+  };
+
+  const BroadPhaseRun broadPhaseRuns[] = {
+      {"grid", Solver::BroadPhase::UniformGrid},
+      {"sap", Solver::BroadPhase::SweepAndPrune},
+      {"all-pairs", Solver::BroadPhase::AllPairs},
+  };
+
+  // Rows of balls 2.2 radii apart from the container's bottom up, within its circle, slightly jittered so that the
+  // pile doesn't stay a perfect lattice. Rows are in memory order, like a pile that was spawned row by row.
+  std::vector<VerletObject> makePile(int n, float radius, std::mt19937 &rndGen)
+  {
+    std::uniform_real_distribution<float> jitter(-0.05f * radius, 0.05f * radius);
+    std::vector<VerletObject> objects;
+    objects.reserve(n);
+    const float spacing = 2.2f * radius;
+    const float border = 1.0f - radius;
+    for (float y = -border; y < border && static_cast<int>(objects.size()) < n; y += spacing)
+    {
+      const float halfWidth = std::sqrt(std::max(border * border - y * y, 0.0f));
+      for (float x = -halfWidth; x <= halfWidth && static_cast<int>(objects.size()) < n; x += spacing)
+      {
+        const glm::vec2 pos{x + jitter(rndGen), y};
+        objects.push_back(VerletObject{.position_current = pos, .position_old = pos, .radius = radius});
+      }
+    }
+    return objects;
+  }
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parseOptions(argc, argv, opt))
+  {
+    std::fprintf(stderr, "usage: %s [--n N] [--radius R] [--broad-phase grid|sap|all-pairs|all] [--threads T]\n"
+                         "  [--substeps K] [--iterations I] [--settle U] [--steps S] [--seed S] [--shuffle]\n"
+                         "  [--reorder-every R] [--sleeping] [--sleep-warmup U]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  // n pi r^2 = pi / 2
+  const float radius = opt.radius > 0.0f ? opt.radius : std::sqrt(0.5f / static_cast<float>(opt.n));
+  std::mt19937 rndGen(opt.seed);
+  std::vector<VerletObject> pile = makePile(opt.n, radius, rndGen);
+  std::unique_ptr<ws::ThreadPool> threadPool;
+  if (opt.threads > 1)
+    threadPool = std::make_unique<ws::ThreadPool>(opt.threads);
+
+  const auto configure = [&](Solver &solver, Solver::BroadPhase broadPhase)
+  {
+    solver.broadPhase = broadPhase;
+    solver.numSubsteps = opt.substeps;
+    solver.numIterations = opt.iterations;
+    solver.threadPool = threadPool.get();
+    solver.allowSleeping = false;
+  };
+  {
+    Solver settler(pile);
+    configure(settler, Solver::BroadPhase::UniformGrid);
+    for (int k = 0; k < opt.settle; ++k)
+      settler.update(dt);
+  }
+  if (opt.shuffle)
+    std::shuffle(pile.begin(), pile.end(), rndGen);
+
+  std::printf("{\n");
+  std::printf("  \"num_objects\": %zu,\n", pile.size());
+  std::printf("  \"radius\": %g,\n", radius);
+  std::printf("  \"threads\": %d,\n", opt.threads);
+  std::printf("  \"substeps\": %d,\n", opt.substeps);
+  std::printf("  \"iterations\": %d,\n", opt.iterations);
+  std::printf("  \"settle_updates\": %d,\n", opt.settle);
+  std::printf("  \"steps\": %d,\n", opt.steps);
+  std::printf("  \"shuffle\": %s,\n", opt.shuffle ? "true" : "false");
+  std::printf("  \"reorder_every\": %d,\n", opt.reorderEvery);
+  if (opt.sleeping)
+    std::printf("  \"sleep_warmup_updates\": %d,\n", opt.sleepWarmup);
+  std::printf("  \"results\": [");
+  bool isFirst = true;
+  for (const BroadPhaseRun &run : broadPhaseRuns)
+    for (const bool allowSleeping : {false, true})
+    {
+      if (opt.broadPhase != "all" && opt.broadPhase != run.name)
+        continue;
+      if (allowSleeping && !opt.sleeping)
+        continue;
+
+      std::vector<VerletObject> objects = pile;
+      Solver solver(objects);
+      configure(solver, run.broadPhase);
+      solver.allowSleeping = allowSleeping;
+      if (opt.sleeping)
+        for (int k = 0; k < opt.sleepWarmup; ++k)
+          solver.update(dt);
+      double collisionMs{};
+      double sleepingMs{};
+      const auto start = std::chrono::steady_clock::now();
+      if (opt.reorderEvery > 0)
+        solver.reorderMorton();
+      for (int k = 0; k < opt.steps; ++k)
+      {
+        solver.update(dt);
+        collisionMs += solver.collisionMs;
+        sleepingMs += solver.sleepingMs;
+        if (opt.reorderEvery > 0 && (k + 1) % opt.reorderEvery == 0)
+          solver.reorderMorton();
+      }
+      const std::chrono::duration<double, std::milli> duration = std::chrono::steady_clock::now() - start;
+      const double msPerUpdate = duration.count() / opt.steps;
+
+      std::printf("%s\n    {\n", isFirst ? "" : ",");
+      isFirst = false;
+      std::printf("      \"broad_phase\": \"%s\",\n", run.name);
+      std::printf("      \"ms_per_update\": %.6g,\n", msPerUpdate);
+      std::printf("      \"ms_per_substep\": %.6g,\n", msPerUpdate / opt.substeps);
+      std::printf("      \"collision_ms_per_update\": %.6g", collisionMs / opt.steps);
+      if (opt.sleeping)
+        std::printf(",\n      \"sleeping\": %s,\n      \"sleeping_ms_per_update\": %.6g,\n      \"num_asleep\": %zu",
+                    allowSleeping ? "true" : "false", sleepingMs / opt.steps, solver.numAsleep);
+      std::printf("\n");
+      std::printf("    }");
+    }
+  std::printf("\n  ]\n}\n");
+  return 0;
+}
@@ -1,111 +1,99 @@
+#include "SlotPool.h"
+#include "Verlet.h"
+
 #include <App.h>
 #include <Mesh.h>
+#include <MortonOrder.h>
+#include <PointMesh.h>
 #include <Shader.h>
+#include <ThreadPool.h>
 
 #include <glad/gl.h>
 #include <glm/vec2.hpp>
 #include <glm/geometric.hpp>
 #include <imgui.h>
 
-#include <functional>
+#include <chrono>
 #include <memory>
 #include <random>
 #include <vector>
 
-struct VerletObject
-{
-  glm::vec2 position_current{};
-  glm::vec2 position_old{};
-  std::function<glm::vec2(const glm::vec2 &)> potentialForce;
-  float mass = 1.0f;
-  float radius = 0.1f;
-
-  VerletObject(glm::vec2 pos, std::function<glm::vec2(const glm::vec2 &)> potentialForce)
-      : position_current(pos), potentialForce(potentialForce)
-  {
-    const float dt = 1.f / 60;
-    position_current = pos;
-    const glm::vec2 acc = potentialForce(position_current) / mass;
-    position_old = position_current - .5f * acc * dt * dt;
-  }
-
-  void updatePosition(float dt)
-  {
-    // calculate forces
-    const glm::vec2 acc = potentialForce(position_current) / mass;
-
-    // apply boundry constraint
-    const glm::vec2 center = {0, 0};
-    const float border = 1.0f;
-    const glm::vec2 relPos = position_current - center;
-    const float dist = glm::length(relPos);
-    if (dist > border - radius)
-    {
-      const glm::vec2 n = glm::normalize(relPos);
-      position_current = center + n * (border - radius);
-
-      // might need to update position_old if change in position_current is big.
-      // const glm::vec2 acc2 = potentialForce(position_current) / mass;
-      // position_old = position_current - .5f * acc2 * dt * dt;
-    }
-
-    // update position
-    const glm::vec2 velocity = position_current - position_old;
-    position_old = position_current;
-    // position-Verlet
-    position_current = position_current + velocity + acc * dt * dt;
-  }
-};
-
-class Solver
-{
-public:
-  std::vector<VerletObject> &objects;
-
-  Solver(std::vector<VerletObject> &objects) : objects(objects) {}
-
-  void update(float dt)
-  {
-    // collision constraint
-    for (size_t i = 0; i < objects.size(); ++i)
-    {
-      for (size_t j = i + 1; j < objects.size(); ++j)
-      {
-        VerletObject &o1 = objects[i];
-        VerletObject &o2 = objects[j];
-        const glm::vec2 disp = o1.position_current - o2.position_current;
-        const float dist = glm::length(disp);
-        if (const float delta = dist - (o1.radius + o2.radius); delta < 0)
-        {
-          const glm::vec2 n = glm::normalize(disp);
-          o1.position_current -= 0.5f * delta * n;
-          o2.position_current += 0.5f * delta * n;
-        }
-      }
-    }
-
-    for (VerletObject &obj : objects)
-      obj.updatePosition(dt);
-  }
-};
-
 class MyApp : public ws::App
 {
 public:
   std::vector<VerletObject> objects;
   std::unique_ptr<Solver> solver;
+  // solver->threadPool, recreated when the number of threads is changed in the UI
+  std::unique_ptr<ws::ThreadPool> threadPool;
+  int numThreads = static_cast<int>(ws::ThreadPool::defaultNumThreads());
+  // duration of the last update, and results of the last "Measure Speed-up", in ms per update
+  float stepMs = 0.0f;
+  float serialStepMs = 0.0f;
+  float parallelStepMs = 0.0f;
+  // most balls the "max balls" slider allows. Objects and the per ball buffers are allocated for this many up front.
+  static constexpr int ballCapacity = 100000;
+  // slot of every object in ballMesh, which its color comes from. Follows the objects when they are reordered.
+  std::vector<uint32_t> objectSlots;
+  SlotPool slotPool{ballCapacity};
+  // objects are sorted along a Z-order curve every this many updates, 0 never, see Solver::reorderMorton()
+  int reorderEvery = 60;
+  int numUpdatesSinceReorder = 0;
 
   std::unique_ptr<ws::Shader> quadShader;
   std::unique_ptr<ws::Shader> pointShader;
-  std::unique_ptr<ws::Mesh> mesh;
+  // only positions are uploaded every frame, colors, radii and indices when balls are spawned or removed
+  std::unique_ptr<ws::PointMesh> ballMesh;
   std::unique_ptr<ws::Mesh> backgroundMesh;
 
-  std::function<glm::vec2(const glm::vec2 &)> gravity = [](const glm::vec2 &)
-  { return glm::vec2{0.0f, -1.0f}; };
-
   std::mt19937 rndGen;
   std::uniform_real_distribution<float> rndDist;
 
+  void spawn(const VerletObject &obj)
+  {
+    const uint32_t slot = slotPool.acquire();
+    objects.push_back(obj);
+    objectSlots.push_back(slot);
+    ballMesh->setAttributes(slot, {{(slot % 256) / 256.f, (slot + 128) % 256 / 256.f, 1, 1}, {obj.radius, 0, 0, 0}});
+  }
+
+  // Removes the objects from count on, their slots are reused by later spawns
+  void truncateBalls(size_t count)
+  {
+    if (count >= objects.size())
+      return;
+    for (size_t ix = count; ix < objects.size(); ++ix)
+      slotPool.release(objectSlots[ix]);
+    objectSlots.resize(count);
+    solver->truncate(count);
+    ballMesh->setDrawnSlots(objectSlots);
+  }
+
+  // Times updates on a copy of the objects without, then with, the thread pool.
+  // Both runs start from the same state and do the same work, results are identical.
+  void measureSpeedUp(float dt)
+  {
+    const auto msPerStep = [&](ws::ThreadPool *pool)
+    {
+      std::vector<VerletObject> probeObjects = objects;
+      Solver probe(probeObjects);
+      probe.broadPhase = solver->broadPhase;
+      probe.forceField = solver->forceField;
+      probe.allowSleeping = solver->allowSleeping;
+      probe.sleepSpeed = solver->sleepSpeed;
+      probe.numSubsteps = solver->numSubsteps;
+      probe.numIterations = solver->numIterations;
+      probe.threadPool = pool;
+      const int numSteps = 10;
+      const auto start = std::chrono::steady_clock::now();
+      for (int n = 0; n < numSteps; ++n)
+        probe.update(dt);
+      const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+      return duration.count() / numSteps;
+    };
+    serialStepMs = msPerStep(nullptr);
+    parallelStepMs = msPerStep(threadPool.get());
+  }
+
   MyApp() : App({.name = "MyApp", .width = 800u, .height = 800u, .shouldDebugOpenGL = true}) {}
 
   void onInit() final
@@ -192,21 +180,17 @@ void main()
     pointShader = std::make_unique<ws::Shader>(mainShaderVertex, pointShaderFragment);
     quadShader = std::make_unique<ws::Shader>(mainShaderVertex, diskShaderFragment);
 
-    // objects with which to start
-    // objects.emplace_back(VerletObject{{0.5, 0.0}, gravity});
-    // objects[0].radius = 0.2f;
-    // objects.emplace_back(VerletObject{{-0.25, 0.0}, gravity});
-    // objects[1].radius = 0.1f;
+    objects.reserve(ballCapacity);
+    objectSlots.reserve(ballCapacity);
+    ballMesh = std::make_unique<ws::PointMesh>(ballCapacity);
     solver = std::make_unique<Solver>(objects);
+    threadPool = std::make_unique<ws::ThreadPool>(numThreads);
+    solver->threadPool = threadPool.get();
 
-    mesh = std::make_unique<ws::Mesh>(objects.size());
-    for (uint32_t ix = 0; const auto &obj : objects)
-    {
-      mesh->verts[ix] = ws::DefaultVertex{{obj.position_current.x, obj.position_current.y, 0}, {}, {}, {1, 1, 1, 1}, {obj.radius, 0, 0, 0}};
-      mesh->idxs[ix] = ix;
-      ix++;
-    }
-    mesh->uploadData();
+    // objects with which to start
+    // spawn(VerletObject{.position_current = {0.5, 0.0}, .position_old = {0.5, 0.0}, .radius = 0.2f});
+    // spawn(VerletObject{.position_current = {-0.25, 0.0}, .position_old = {-0.25, 0.0}, .radius = 0.1f});
+    ballMesh->setDrawnSlots(objectSlots);
 
     backgroundMesh.reset(new ws::Mesh(ws::Mesh::makeQuad())); // does not call Mesh destructor
     // backgroundMesh = std::make_unique<ws::Mesh>(ws::Mesh::makeQuad()); // calls Mesh destructor -> glDeletes buffers
@@ -232,41 +216,89 @@ void main()
     float period = 0.05f;
     static float remaining = period;
     static int maxBalls = 100;
+    // spawned side by side at every period, to fill the container with many small balls in reasonable time
+    static int ballsPerSpawn = 1;
     static float minRadius = 0.01f;
     static float maxRadius = 0.05f;
     remaining -= deltaTime;
-    if (remaining < 0 && mesh->verts.size() < maxBalls)
+    if (remaining < 0 && objects.size() < maxBalls)
     {
-      objects.emplace_back(VerletObject{{0.0, 0.9}, gravity});
-      auto &obj = objects[objects.size() - 1];
-      obj.radius = (maxRadius - minRadius) * rndDist(rndGen) + minRadius;
-      obj.position_old = obj.position_current + glm::vec2{std::sin(time) * 0.02, 0.02};
+      const int numSpawned = std::min(ballsPerSpawn, maxBalls - static_cast<int>(objects.size()));
+      // centered row within the container's top, at most two balls per max diameter
+      const float spacing = std::min(2.0f * maxRadius, 1.6f / static_cast<float>(numSpawned));
+      for (int k = 0; k < numSpawned; ++k)
+      {
+        const float x = (static_cast<float>(k) - 0.5f * static_cast<float>(numSpawned - 1)) * spacing;
+        const glm::vec2 pos{x, 0.9f};
+        spawn(VerletObject{
+            .position_current = pos,
+            .position_old = pos + glm::vec2{std::sin(time) * 0.02f, 0.02f},
+            .radius = (maxRadius - minRadius) * rndDist(rndGen) + minRadius,
+        });
+      }
       remaining = period;
-
-      mesh->verts.resize(objects.size());
-      mesh->idxs.resize(objects.size());
+      ballMesh->setDrawnSlots(objectSlots);
     }
 
+    const auto stepStart = std::chrono::steady_clock::now();
     solver->update(deltaTime);
-    for (uint32_t ix = 0; const auto &obj : objects)
+    if (reorderEvery > 0 && ++numUpdatesSinceReorder >= reorderEvery)
     {
-      mesh->verts[ix] = ws::DefaultVertex{{obj.position_current.x, obj.position_current.y, 0}, {}, {}, {(ix % 256) / 256., (ix + 128) % 256 / 256., 1, 1}, {obj.radius, 0, 0, 0}};
-      mesh->idxs[ix] = ix;
-      ix++;
+      ws::permuteByRemap(objectSlots, solver->reorderMorton());
+      numUpdatesSinceReorder = 0;
     }
-    // when the number of objects is constant
-    // for (size_t ix = 0; const auto &obj : objects)
-    //   mesh->verts[ix++].position = {obj.position_current.x, obj.position_current.y, 0};
-
-    // mesh->verts[0].position.y = std::sin(time) * 0.5f;
-    // mesh->verts[0].position.x = std::cos(time) * 0.5f;
-    mesh->uploadData();
+    const std::chrono::duration<float, std::milli> stepDuration = std::chrono::steady_clock::now() - stepStart;
+    stepMs = stepDuration.count();
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+      ballMesh->positions[objectSlots[ix]] = objects[ix].position_current;
+    ballMesh->uploadData(slotPool.getHighWaterMark());
 
     ImGui::Begin("Verlet Simulation");
-    ImGui::Text("num balls: %d", mesh->verts.size());
+    ImGui::Text("num balls: %zu", objects.size());
     ImGui::Text("FPS: %.1f", 1.0f / deltaTime);
     ImGui::SliderFloat("gen period", &period, 0.01f, 0.5f, "%.2f");
-    ImGui::SliderInt("max balls", &maxBalls, 100, 1000);
+    if (ImGui::SliderInt("max balls", &maxBalls, 100, ballCapacity, "%d", ImGuiSliderFlags_Logarithmic))
+      truncateBalls(maxBalls);
+    ImGui::SameLine();
+    if (ImGui::Button("Clear"))
+      truncateBalls(0);
+    ImGui::SliderInt("balls per spawn", &ballsPerSpawn, 1, 64);
+    int broadPhaseIx = static_cast<int>(solver->broadPhase);
+    if (ImGui::Combo("Broad Phase", &broadPhaseIx, "All Pairs\0Uniform Grid\0Sweep and Prune\0"))
+      solver->broadPhase = static_cast<Solver::BroadPhase>(broadPhaseIx);
+    ForceField &field = solver->forceField;
+    ImGui::SliderFloat2("gravity", &field.gravity.x, -2.0f, 2.0f, "%.2f");
+    // a single attractor and vortex at the center, strength 0 switches them off
+    static float attractorStrength = 0.0f;
+    static float vortexStrength = 0.0f;
+    ImGui::SliderFloat("attractor", &attractorStrength, -0.1f, 0.1f, "%.3f");
+    ImGui::SliderFloat("vortex", &vortexStrength, -5.0f, 5.0f, "%.2f");
+    field.attractors.clear();
+    if (attractorStrength != 0.0f)
+      field.attractors.push_back({.strength = attractorStrength});
+    field.vortices.clear();
+    if (vortexStrength != 0.0f)
+      field.vortices.push_back({.strength = vortexStrength});
+    ImGui::Checkbox("sleeping", &solver->allowSleeping);
+    ImGui::SameLine();
+    ImGui::Text("asleep: %zu", solver->numAsleep);
+    ImGui::SliderFloat("sleep speed", &solver->sleepSpeed, 0.001f, 0.5f, "%.3f", ImGuiSliderFlags_Logarithmic);
+    ImGui::SliderInt("substeps", &solver->numSubsteps, 1, 8);
+    ImGui::SliderInt("iterations", &solver->numIterations, 1, 8);
+    ImGui::Text("update: %.2f ms, collisions: %.2f ms, sleeping: %.2f ms", stepMs, solver->collisionMs, solver->sleepingMs);
+    if (ImGui::SliderInt("threads", &numThreads, 1, static_cast<int>(ws::ThreadPool::defaultNumThreads())))
+    {
+      threadPool = std::make_unique<ws::ThreadPool>(numThreads);
+      solver->threadPool = threadPool.get();
+    }
+    ImGui::SliderInt("reorder every", &reorderEvery, 0, 600);
+    if (ImGui::Button("Measure Speed-up"))
+      measureSpeedUp(deltaTime);
+    if (serialStepMs > 0.0f)
+    {
+      ImGui::SameLine();
+      ImGui::Text("serial: %.2f ms, %d threads: %.2f ms, %.2fx", serialStepMs, numThreads, parallelStepMs, serialStepMs / parallelStepMs);
+    }
     ImGui::SliderFloat("max radius", &maxRadius, 0.001f, 0.20f, "%.3f");
     if (maxRadius < minRadius)
       minRadius = maxRadius;
@@ -285,8 +317,7 @@ void main()
 
     glUseProgram(pointShader->getId());
     pointShader->setVector2fv("RenderTargetSize", rts);
-    glBindVertexArray(mesh->vao);
-    glDrawElements(GL_POINTS, static_cast<GLsizei>(mesh->idxs.size()), GL_UNSIGNED_INT, 0);
+    ballMesh->draw();
   }
 
   void onDeinit() final
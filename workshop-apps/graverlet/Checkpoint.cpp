@@ -0,0 +1,125 @@
+#include "Checkpoint.h"
+
+#include "ForceLaws.h"
+#include "Integrators.h"
+#include "Trajectory.h"
+
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+
+namespace checkpoint
+{
+  bool save(const std::filesystem::path &path, const Settings &settings, const std::vector<VerletObject> &objects,
+            const std::vector<glm::vec4> &colors, const std::mt19937 &rndGen)
+  {
+    std::ostringstream rngStream;
+    rngStream << rndGen;
+    const std::string rngState = rngStream.str();
+
+    Header header;
+    header.numObjects = objects.size();
+    header.rngStateBytes = rngState.size();
+    header.settings = settings;
+
+    const size_t objectBytes = objects.size() * sizeof(VerletObject);
+    const size_t colorBytes = objects.size() * sizeof(glm::vec4);
+    std::vector<uint8_t> buffer(sizeof(Header) + objectBytes + colorBytes + rngState.size());
+    uint8_t *out = buffer.data();
+    std::memcpy(out, &header, sizeof(Header));
+    out += sizeof(Header);
+    std::memcpy(out, objects.data(), objectBytes);
+    out += objectBytes;
+    // objects without a vertex color are white
+    for (size_t ix = 0; ix < objects.size(); ++ix, out += sizeof(glm::vec4))
+    {
+      const glm::vec4 color = ix < colors.size() ? colors[ix] : glm::vec4{1, 1, 1, 1};
+      std::memcpy(out, &color, sizeof(glm::vec4));
+    }
+    std::memcpy(out, rngState.data(), rngState.size());
+
+    std::filesystem::path tmpPath = path;
+    tmpPath += ".tmp";
+    std::FILE *file = std::fopen(tmpPath.string().c_str(), "wb");
+    if (file == nullptr)
+    {
+      std::cerr << "error creating checkpoint " << tmpPath.string() << "\n";
+      return false;
+    }
+    const bool isWritten = std::fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size();
+    if (std::fclose(file) != 0 || !isWritten)
+    {
+      std::cerr << "error writing checkpoint " << tmpPath.string() << "\n";
+      return false;
+    }
+    std::error_code error;
+    std::filesystem::rename(tmpPath, path, error);
+    if (error)
+    {
+      std::cerr << "error replacing checkpoint " << path.string() << ": " << error.message() << "\n";
+      return false;
+    }
+    return true;
+  }
+
+  bool load(const std::filesystem::path &path, Settings &settings, std::vector<VerletObject> &objects,
+            std::vector<glm::vec4> &colors, std::mt19937 &rndGen)
+  {
+    trajectory::MappedFile file;
+    if (!file.open(path))
+    {
+      std::cerr << "error mapping checkpoint " << path.string() << "\n";
+      return false;
+    }
+    const Header expected;
+    Header header;
+    if (file.size() >= sizeof(Header))
+      std::memcpy(&header, file.data(), sizeof(Header));
+    // counts bounded by the file size before multiplying, corrupt ones could overflow the sizes into a match
+    if (header.numObjects > file.size() / (sizeof(VerletObject) + sizeof(glm::vec4)) || header.rngStateBytes > file.size())
+    {
+      std::cerr << "not a checkpoint of this version: " << path.string() << "\n";
+      return false;
+    }
+    const size_t objectBytes = header.numObjects * sizeof(VerletObject);
+    const size_t colorBytes = header.numObjects * sizeof(glm::vec4);
+    if (file.size() < sizeof(Header) || std::memcmp(header.magic, expected.magic, sizeof(expected.magic)) != 0 ||
+        header.version != expected.version || header.objectSize != expected.objectSize ||
+        file.size() != sizeof(Header) + objectBytes + colorBytes + header.rngStateBytes)
+    {
+      std::cerr << "not a checkpoint of this version: " << path.string() << "\n";
+      return false;
+    }
+
+    // indices into the app's tables, out of range they would be read past their ends
+    const Settings &s = header.settings;
+    if (s.solverMethod < 0 || s.solverMethod >= numSolverMethods || s.forceLawIx < 0 ||
+        s.forceLawIx >= static_cast<int>(std::variant_size_v<ForceLaw>) || s.integratorIx < 0 ||
+        s.integratorIx >= static_cast<int>(integrator::schemes.size()))
+    {
+      std::cerr << "invalid settings in checkpoint " << path.string() << "\n";
+      return false;
+    }
+
+    std::mt19937 restoredRndGen;
+    const uint8_t *in = file.data() + sizeof(Header) + objectBytes + colorBytes;
+    std::istringstream rngStream(std::string(reinterpret_cast<const char *>(in), header.rngStateBytes));
+    rngStream >> restoredRndGen;
+    if (rngStream.fail())
+    {
+      std::cerr << "corrupt random generator state in checkpoint " << path.string() << "\n";
+      return false;
+    }
+
+    in = file.data() + sizeof(Header);
+    objects.resize(header.numObjects);
+    std::memcpy(objects.data(), in, objectBytes);
+    colors.resize(header.numObjects);
+    std::memcpy(colors.data(), in + objectBytes, colorBytes);
+    settings = header.settings;
+    rndGen = restoredRndGen;
+    return true;
+  }
+} // namespace checkpoint
@@ -0,0 +1,63 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <glm/vec4.hpp>
+
+#include <cstdint>
+#include <filesystem>
+#include <random>
+#include <type_traits>
+#include <vector>
+
+// Snapshots of a running simulation for restarting it later. A snapshot is a single contiguous file:
+//   Header, Settings
+//   numObjects x VerletObject    as in memory, including acc and stepLevel, so that no force pass is needed on restart
+//   numObjects x glm::vec4       colors of the objects' vertices
+//   rngStateBytes                text form of the std::mt19937 state
+// It is assembled in memory and written with one call, to a temporary file that then replaces the previous snapshot,
+// so that an interrupted save never destroys the last good one. Loading maps the file and copies the arrays out.
+namespace checkpoint
+{
+  // number of alternatives of the app's SolverMethod, solverMethod of a loaded checkpoint is checked against it
+  inline constexpr int numSolverMethods = 7;
+
+  // everything of the app that affects how the simulation continues
+  struct Settings
+  {
+    int solverMethod{};
+    int numIter{};
+    int fmmOrder{};
+    int maxStepLevel{};
+    int integratorIx{};
+    int forceLawIx{};
+    float cellSize{};
+    float theta{};
+    float stepEta{};
+    float softening{};
+    float softeningLength{};
+    float ljEpsilon{};
+    float ljSigma{};
+    // days per second
+    float speed{};
+    double simTime{};
+  };
+
+  struct Header
+  {
+    char magic[8] = {'G', 'V', 'C', 'K', 'P', 'T', '0', '1'};
+    uint32_t version = 1;
+    uint32_t objectSize = sizeof(VerletObject);
+    uint64_t numObjects{};
+    uint64_t rngStateBytes{};
+    Settings settings;
+  };
+  static_assert(std::is_trivially_copyable_v<Header> && std::is_trivially_copyable_v<VerletObject>);
+
+  // False if the file can't be written.
+  bool save(const std::filesystem::path &path, const Settings &settings, const std::vector<VerletObject> &objects,
+            const std::vector<glm::vec4> &colors, const std::mt19937 &rndGen);
+  // False if the file can't be read or is not a snapshot of this build, outputs are unchanged then.
+  bool load(const std::filesystem::path &path, Settings &settings, std::vector<VerletObject> &objects,
+            std::vector<glm::vec4> &colors, std::mt19937 &rndGen);
+} // namespace checkpoint
@@ -0,0 +1,371 @@
+#pragma once
+
+#include "ForceLaws.h"
+#include "VerletObject.h"
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Fast multipole method for the softened 1/r potential of the Plummer-form force laws in the plane.
+// The kernel phi(x) = (|x|^2 + softening2)^(-1/2) is not harmonic in 2D, so instead of complex expansions it uses
+// Cartesian Taylor expansions up to order p (coefficients with multi-index k = (kx, ky), |k| = kx + ky <= p):
+//   multipole of a cell around its center c: M_k = sum_j m_j (p_j - c)^k
+//   local expansion around a cell center d:   Phi(d + y) = sum_l L_l y^l,  Phi(x) = sum_j m_j phi(x - p_j)
+// Taylor coefficients T_k = D^k phi / k! of the kernel come from the recurrence of Duan & Krasny (2001),
+// which holds with |x|^2 replaced by |x|^2 + softening2:
+//   |k| s T_k + (2 |k| - 1) sum_i x_i T_(k - e_i) + (|k| - 1) sum_i T_(k - 2 e_i) = 0,  s = |x|^2 + softening2
+// The tree is a uniform quadtree over the bounding square. Cells interact through expansions when they are
+// not adjacent but their parents are (interaction list), adjacent leaves interact directly with the force law.
+// Stages are exposed separately so that the caller can run the cells of a stage in parallel.
+class Fmm
+{
+public:
+  static constexpr int maxOrder = 12;
+  // average number of objects per leaf the depth of the tree is chosen for
+  static constexpr size_t objectsPerLeaf = 32;
+  static constexpr int maxLevels = 10;
+
+  // Sorts objects into the leaves of a tree covering them. Levels [2, leafLevel()] take part in the expansion passes.
+  void build(const std::vector<VerletObject> &objects, int order)
+  {
+    p = std::clamp(order, 1, maxOrder);
+    numCoeffs = coeffCount(p);
+    prepareBinomials();
+
+    glm::vec2 lo{std::numeric_limits<float>::max()};
+    glm::vec2 hi{std::numeric_limits<float>::lowest()};
+    for (const auto &obj : objects)
+    {
+      lo = glm::min(lo, obj.pos);
+      hi = glm::max(hi, obj.pos);
+    }
+    if (objects.empty())
+      lo = hi = {};
+    // slightly larger than the bounding box so that objects on its max edges fall into the last cells
+    size = std::max({hi.x - lo.x, hi.y - lo.y, 1e-6f}) * 1.0001f;
+    origin = (lo + hi) * 0.5f - glm::vec2{size * 0.5f};
+
+    int leafLvl = 2;
+    while (leafLvl + 1 < maxLevels && (size_t{1} << (2 * leafLvl)) * objectsPerLeaf < objects.size())
+      ++leafLvl;
+    numLevels = leafLvl + 1;
+
+    // counting sort by leaf
+    const size_t numLeaves = numCells(leafLvl);
+    leafOfObject.resize(objects.size());
+    leafStarts.assign(numLeaves + 1, 0);
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+    {
+      leafOfObject[ix] = cellOf(objects[ix].pos, leafLvl);
+      ++leafStarts[leafOfObject[ix] + 1];
+    }
+    for (size_t c = 0; c < numLeaves; ++c)
+      leafStarts[c + 1] += leafStarts[c];
+    objIdxs.resize(objects.size());
+    leafCursors.assign(leafStarts.begin(), leafStarts.end() - 1);
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+      objIdxs[leafCursors[leafOfObject[ix]]++] = static_cast<uint32_t>(ix);
+
+    // occupancy of every level, empty cells are skipped by all passes
+    counts.resize(numLevels);
+    multipoles.resize(numLevels);
+    locals.resize(numLevels);
+    for (int level = 0; level < numLevels; ++level)
+    {
+      counts[level].assign(numCells(level), 0);
+      multipoles[level].assign(numCells(level) * numCoeffs, 0.0);
+      locals[level].assign(numCells(level) * numCoeffs, 0.0);
+    }
+    for (size_t c = 0; c < numLeaves; ++c)
+      counts[leafLvl][c] = leafStarts[c + 1] - leafStarts[c];
+    for (int level = leafLvl - 1; level >= 0; --level)
+    {
+      const int n = cellsPerAxis(level + 1);
+      for (int j = 0; j < n; ++j)
+        for (int i = 0; i < n; ++i)
+          counts[level][cellIndex(level, i / 2, j / 2)] += counts[level + 1][cellIndex(level + 1, i, j)];
+    }
+  }
+
+  int leafLevel() const { return numLevels - 1; }
+  int getOrder() const { return p; }
+  size_t numCells(int level) const { return size_t{1} << (2 * level); }
+
+  // P2M for leaves [begin, end)
+  void computeLeafMultipoles(const std::vector<VerletObject> &objects, size_t begin, size_t end)
+  {
+    const int level = leafLevel();
+    std::vector<double> powX(p + 1), powY(p + 1);
+    for (size_t c = begin; c < end; ++c)
+    {
+      double *m = &multipoles[level][c * numCoeffs];
+      const glm::dvec2 center = cellCenter(level, c);
+      for (size_t k = leafStarts[c]; k < leafStarts[c + 1]; ++k)
+      {
+        const VerletObject &obj = objects[objIdxs[k]];
+        powers(glm::dvec2{obj.pos.x, obj.pos.y} - center, powX, powY);
+        for (int n = 0; n <= p; ++n)
+          for (int b = 0; b <= n; ++b)
+            m[coeffIndex(n - b, b)] += obj.mass * powX[n - b] * powY[b];
+      }
+    }
+  }
+
+  // M2M into cells [begin, end) of level from their children
+  void translateMultipolesUp(int level, size_t begin, size_t end)
+  {
+    std::vector<double> powX(p + 1), powY(p + 1);
+    for (size_t c = begin; c < end; ++c)
+    {
+      if (counts[level][c] == 0)
+        continue;
+      double *parent = &multipoles[level][c * numCoeffs];
+      const glm::dvec2 center = cellCenter(level, c);
+      const int i = static_cast<int>(c % cellsPerAxis(level));
+      const int j = static_cast<int>(c / cellsPerAxis(level));
+      for (int child = 0; child < 4; ++child)
+      {
+        const size_t cc = cellIndex(level + 1, 2 * i + child % 2, 2 * j + child / 2);
+        if (counts[level + 1][cc] == 0)
+          continue;
+        const double *m = &multipoles[level + 1][cc * numCoeffs];
+        powers(cellCenter(level + 1, cc) - center, powX, powY);
+        for (int n = 0; n <= p; ++n)
+          for (int ky = 0; ky <= n; ++ky)
+          {
+            const int kx = n - ky;
+            double sum{};
+            for (int jx = 0; jx <= kx; ++jx)
+              for (int jy = 0; jy <= ky; ++jy)
+                sum += binomial(kx, jx) * binomial(ky, jy) * m[coeffIndex(jx, jy)] * powX[kx - jx] * powY[ky - jy];
+            parent[coeffIndex(kx, ky)] += sum;
+          }
+      }
+    }
+  }
+
+  // L2L from the parents and M2L from the interaction lists into cells [begin, end) of level (>= 2).
+  // Parents' locals have to be complete.
+  void computeLocals(int level, float softening2, size_t begin, size_t end)
+  {
+    std::vector<double> powX(p + 1), powY(p + 1);
+    std::vector<double> taylor(coeffCount(2 * p));
+    const int n = cellsPerAxis(level);
+    for (size_t c = begin; c < end; ++c)
+    {
+      if (counts[level][c] == 0)
+        continue;
+      double *loc = &locals[level][c * numCoeffs];
+      const glm::dvec2 center = cellCenter(level, c);
+      const int i = static_cast<int>(c % n);
+      const int j = static_cast<int>(c / n);
+
+      // L2L, the expansion of the parent shifted to this cell's center
+      const size_t pc = cellIndex(level - 1, i / 2, j / 2);
+      const double *parentLoc = &locals[level - 1][pc * numCoeffs];
+      powers(center - cellCenter(level - 1, pc), powX, powY);
+      for (int ln = 0; ln <= p; ++ln)
+        for (int ly = 0; ly <= ln; ++ly)
+        {
+          const int lx = ln - ly;
+          double sum{};
+          for (int kn = ln; kn <= p; ++kn)
+            for (int ky = ly; ky <= kn; ++ky)
+            {
+              const int kx = kn - ky;
+              if (kx < lx)
+                continue;
+              sum += binomial(kx, lx) * binomial(ky, ly) * parentLoc[coeffIndex(kx, ky)] * powX[kx - lx] * powY[ky - ly];
+            }
+          loc[coeffIndex(lx, ly)] = sum;
+        }
+
+      // M2L, children of the parent's neighbors that are not adjacent to this cell
+      const int si0 = std::max(i / 2 - 1, 0) * 2;
+      const int sj0 = std::max(j / 2 - 1, 0) * 2;
+      const int si1 = std::min(i / 2 + 1, n / 2 - 1) * 2 + 1;
+      const int sj1 = std::min(j / 2 + 1, n / 2 - 1) * 2 + 1;
+      for (int sj = sj0; sj <= sj1; ++sj)
+        for (int si = si0; si <= si1; ++si)
+        {
+          if (std::abs(si - i) <= 1 && std::abs(sj - j) <= 1)
+            continue;
+          const size_t sc = cellIndex(level, si, sj);
+          if (counts[level][sc] == 0)
+            continue;
+          const double *m = &multipoles[level][sc * numCoeffs];
+          kernelTaylorCoefficients(center - cellCenter(level, sc), softening2, 2 * p, taylor);
+          for (int ln = 0; ln <= p; ++ln)
+            for (int ly = 0; ly <= ln; ++ly)
+            {
+              const int lx = ln - ly;
+              double sum{};
+              for (int kn = 0; kn <= p; ++kn)
+              {
+                // (-1)^|k| of (-(p_j - c))^k
+                const double sign = kn % 2 == 0 ? 1.0 : -1.0;
+                for (int ky = 0; ky <= kn; ++ky)
+                {
+                  const int kx = kn - ky;
+                  sum += sign * m[coeffIndex(kx, ky)] * binomial(kx + lx, lx) * binomial(ky + ly, ly) * taylor[coeffIndex(kx + lx, ky + ly)];
+                }
+              }
+              loc[coeffIndex(lx, ly)] += sum;
+            }
+        }
+    }
+  }
+
+  // L2P for the far field (if the law has G) plus direct interactions with the adjacent leaves for leaves [begin, end).
+  // Accumulates into acc of the objects in them, returns their potential if WithPotential.
+  template <bool WithPotential, typename Law>
+  double evaluateLeaves(std::vector<VerletObject> &objects, const Law &law, size_t begin, size_t end) const
+  {
+    const int level = leafLevel();
+    const int n = cellsPerAxis(level);
+    std::vector<double> powX(p + 1), powY(p + 1);
+    double potential{};
+    for (size_t c = begin; c < end; ++c)
+    {
+      const int i = static_cast<int>(c % n);
+      const int j = static_cast<int>(c / n);
+      const double *loc = &locals[level][c * numCoeffs];
+      const glm::dvec2 center = cellCenter(level, c);
+      for (size_t k = leafStarts[c]; k < leafStarts[c + 1]; ++k)
+      {
+        VerletObject &obj1 = objects[objIdxs[k]];
+        float pot{};
+        for (int nj = std::max(j - 1, 0); nj <= std::min(j + 1, n - 1); ++nj)
+          for (int ni = std::max(i - 1, 0); ni <= std::min(i + 1, n - 1); ++ni)
+          {
+            const size_t nc = cellIndex(level, ni, nj);
+            for (size_t l = leafStarts[nc]; l < leafStarts[nc + 1]; ++l)
+            {
+              const VerletObject &obj2 = objects[objIdxs[l]];
+              const glm::vec2 r = obj1.pos - obj2.pos;
+              const forcelaw::PairTerms t = law.evaluate(glm::dot(r, r));
+              obj1.acc += (t.forceScale * obj2.mass) * r;
+              if constexpr (WithPotential)
+                pot += obj1.mass * obj2.mass * t.potential;
+            }
+          }
+        potential += pot;
+
+        if constexpr (requires { law.G; })
+        {
+          // Phi and its gradient at the object from the local expansion, a = G grad Phi, potential = -G m Phi
+          powers(glm::dvec2{obj1.pos.x, obj1.pos.y} - center, powX, powY);
+          double phi{}, gradX{}, gradY{};
+          for (int ln = 0; ln <= p; ++ln)
+            for (int ly = 0; ly <= ln; ++ly)
+            {
+              const int lx = ln - ly;
+              const double coeff = loc[coeffIndex(lx, ly)];
+              phi += coeff * powX[lx] * powY[ly];
+              if (lx > 0)
+                gradX += lx * coeff * powX[lx - 1] * powY[ly];
+              if (ly > 0)
+                gradY += ly * coeff * powX[lx] * powY[ly - 1];
+            }
+          obj1.acc += glm::vec2{static_cast<float>(law.G * gradX), static_cast<float>(law.G * gradY)};
+          if constexpr (WithPotential)
+            potential -= static_cast<double>(law.G) * obj1.mass * phi;
+        }
+      }
+    }
+    return potential;
+  }
+
+  // Taylor coefficients T_k, |k| <= order, of (|x|^2 + softening2)^(-1/2) at x, indexed by coeffIndex()
+  static void kernelTaylorCoefficients(glm::dvec2 x, double softening2, int order, std::vector<double> &t)
+  {
+    const double s = x.x * x.x + x.y * x.y + softening2;
+    const double invS = 1.0 / s;
+    t[0] = 1.0 / std::sqrt(s);
+    for (int n = 1; n <= order; ++n)
+      for (int ky = 0; ky <= n; ++ky)
+      {
+        const int kx = n - ky;
+        double sum{};
+        if (kx >= 1)
+          sum += (2 * n - 1) * x.x * t[coeffIndex(kx - 1, ky)];
+        if (ky >= 1)
+          sum += (2 * n - 1) * x.y * t[coeffIndex(kx, ky - 1)];
+        if (kx >= 2)
+          sum += (n - 1) * t[coeffIndex(kx - 2, ky)];
+        if (ky >= 2)
+          sum += (n - 1) * t[coeffIndex(kx, ky - 2)];
+        t[coeffIndex(kx, ky)] = -sum * invS / n;
+      }
+  }
+
+  // multi-indices of the same order |k| are stored next to each other, orders in increasing order
+  static int coeffIndex(int kx, int ky) { return (kx + ky) * (kx + ky + 1) / 2 + ky; }
+  static int coeffCount(int order) { return (order + 1) * (order + 2) / 2; }
+
+private:
+  int cellsPerAxis(int level) const { return 1 << level; }
+  size_t cellIndex(int level, int i, int j) const { return static_cast<size_t>(j) * cellsPerAxis(level) + i; }
+
+  size_t cellOf(glm::vec2 pos, int level) const
+  {
+    const int n = cellsPerAxis(level);
+    const float cellSize = size / n;
+    const int i = std::clamp(static_cast<int>((pos.x - origin.x) / cellSize), 0, n - 1);
+    const int j = std::clamp(static_cast<int>((pos.y - origin.y) / cellSize), 0, n - 1);
+    return cellIndex(level, i, j);
+  }
+
+  glm::dvec2 cellCenter(int level, size_t c) const
+  {
+    const int n = cellsPerAxis(level);
+    const double cellSize = static_cast<double>(size) / n;
+    return {origin.x + (static_cast<double>(c % n) + 0.5) * cellSize, origin.y + (static_cast<double>(c / n) + 0.5) * cellSize};
+  }
+
+  void powers(glm::dvec2 d, std::vector<double> &powX, std::vector<double> &powY) const
+  {
+    powX[0] = powY[0] = 1.0;
+    for (int k = 1; k <= p; ++k)
+    {
+      powX[k] = powX[k - 1] * d.x;
+      powY[k] = powY[k - 1] * d.y;
+    }
+  }
+
+  void prepareBinomials()
+  {
+    const int n = 2 * p + 1;
+    binomials.assign(n * n, 0.0);
+    for (int a = 0; a < n; ++a)
+    {
+      binomials[a * n] = 1.0;
+      for (int b = 1; b <= a; ++b)
+        binomials[a * n + b] = binomials[(a - 1) * n + b - 1] + binomials[(a - 1) * n + b];
+    }
+  }
+
+  double binomial(int a, int b) const { return binomials[a * (2 * p + 1) + b]; }
+
+  int p = 4;
+  int numCoeffs = coeffCount(4);
+  int numLevels = 0;
+  glm::vec2 origin{};
+  float size{};
+  std::vector<double> binomials;
+
+  std::vector<size_t> leafOfObject;
+  std::vector<size_t> leafStarts;
+  std::vector<size_t> leafCursors;
+  std::vector<uint32_t> objIdxs;
+  // per level: number of objects, multipole and local coefficients of every cell
+  std::vector<std::vector<size_t>> counts;
+  std::vector<std::vector<double>> multipoles;
+  std::vector<std::vector<double>> locals;
+};
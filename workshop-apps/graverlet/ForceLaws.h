@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cmath>
+#include <variant>
+
+// Pairwise central force laws used as compile-time policies by Solver and the SoA kernels.
+// evaluate(r2) gets the squared distance between two objects and returns, per unit mass of both:
+//   force:     force on object 1 is m1 m2 forceScale (p1 - p2), i.e. negative forceScale attracts
+//   potential: potential energy of the pair is m1 m2 potential
+// Both are computed in one go, inlining removes the potential when the caller doesn't use it.
+namespace forcelaw
+{
+  struct PairTerms
+  {
+    float forceScale;
+    float potential;
+  };
+
+  // Newtonian gravity with softening added to r^2. This is the law the simulation started with.
+  // https://home.ifa.hawaii.edu/users/barnes/research/smoothing/soft.pdf
+  struct Newtonian
+  {
+    float G;
+    float softening;
+
+    bool operator==(const Newtonian &) const = default;
+
+    // Plummer-form laws expose the term added to r^2, the SIMD kernels are written for this form
+    float softening2() const { return softening; }
+
+    PairTerms evaluate(float r2) const
+    {
+      const float invR = 1.0f / std::sqrt(r2 + softening);
+      return {-G * invR * invR * invR, -G * invR};
+    }
+  };
+
+  // Plummer sphere potential with softening length h: -G m1 m2 / sqrt(r^2 + h^2).
+  // Same shape as Newtonian, but parameterized by a length so that it can be compared to SplineSoftened.
+  struct Plummer
+  {
+    float G;
+    float h;
+
+    bool operator==(const Plummer &) const = default;
+
+    float softening2() const { return h * h; }
+
+    PairTerms evaluate(float r2) const
+    {
+      const float invR = 1.0f / std::sqrt(r2 + h * h);
+      return {-G * invR * invR * invR, -G * invR};
+    }
+  };
+
+  // Cubic spline softening (Monaghan & Lattanzio 1985) as used by GADGET-2 (Springel 2005, eq. 4).
+  // Exactly Newtonian beyond h, finite force and potential at r = 0.
+  struct SplineSoftened
+  {
+    float G;
+    float h;
+
+    bool operator==(const SplineSoftened &) const = default;
+
+    PairTerms evaluate(float r2) const
+    {
+      const float r = std::sqrt(r2);
+      if (r >= h)
+      {
+        const float invR = 1.0f / r;
+        return {-G * invR * invR * invR, -G * invR};
+      }
+      const float invH = 1.0f / h;
+      const float u = r * invH;
+      const float u2 = u * u;
+      float f, w;
+      if (u < 0.5f)
+      {
+        f = 10.666666667f + u2 * (32.0f * u - 38.4f);
+        w = -2.8f + u2 * (5.333333333f + u2 * (6.4f * u - 9.6f));
+      }
+      else
+      {
+        f = 21.333333333f - 48.0f * u + 38.4f * u2 - 10.666666667f * u2 * u - 0.066666667f / (u2 * u);
+        w = -3.2f + 0.066666667f / u + u2 * (10.666666667f + u * (-16.0f + u * (9.6f - 2.133333333f * u)));
+      }
+      return {-G * f * invH * invH * invH, G * w * invH};
+    }
+  };
+
+  // Lennard-Jones-style interaction scaled by both masses: 4 epsilon m1 m2 ((sigma / r)^12 - (sigma / r)^6).
+  // Repulsive core below 2^(1/6) sigma, weakly attractive beyond. Coincident objects (incl. self-pairs) don't interact.
+  struct LennardJones
+  {
+    float epsilon;
+    float sigma;
+
+    bool operator==(const LennardJones &) const = default;
+
+    PairTerms evaluate(float r2) const
+    {
+      if (r2 == 0.0f)
+        return {0.0f, 0.0f};
+      const float s2 = sigma * sigma / r2;
+      const float s6 = s2 * s2 * s2;
+      return {24.0f * epsilon * (2.0f * s6 * s6 - s6) / r2, 4.0f * epsilon * (s6 * s6 - s6)};
+    }
+  };
+} // namespace forcelaw
+
+// Runtime selectable law. Solver visits it once per update so that pair loops are instantiated, and inlined, per law.
+using ForceLaw = std::variant<forcelaw::Newtonian, forcelaw::Plummer, forcelaw::SplineSoftened, forcelaw::LennardJones>;
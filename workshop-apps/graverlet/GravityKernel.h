@@ -0,0 +1,253 @@
+#pragma once
+
+#include "ForceLaws.h"
+#include "Particles.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define GRAVERLET_SIMD_AVX
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRAVERLET_SIMD_SSE
+#endif
+
+// All-pairs force law evaluation over a ParticleStore.
+// Plummer-form laws (those with softening2(), see ForceLaws.h) go through hand written SIMD:
+//   a_i += -G sum_j m_j (p_i - p_j) / (|p_i - p_j|^2 + softening2)^(3/2)
+//   potential = sum_i sum_j -G m_i m_j / (|p_i - p_j|^2 + softening2)^(1/2)
+// other laws through a scalar loop over the same arrays.
+// The sum runs over all ordered pairs including i == j, like Solver::update(). Pairs at distance 0 with softening2 == 0,
+// self-pairs and padding at a particle's position, are masked out, their 1/r would turn the sums into NaN.
+namespace gravity
+{
+#if defined(GRAVERLET_SIMD_AVX)
+  inline constexpr const char *simdPathName = "AVX";
+#elif defined(GRAVERLET_SIMD_SSE)
+  inline constexpr const char *simdPathName = "SSE2";
+#else
+  inline constexpr const char *simdPathName = "scalar";
+#endif
+
+  // sources are visited in blocks of this many particles, x, y and mass of a block take 12 KB and stay in L1
+  inline constexpr std::size_t jBlockSize = 1024;
+
+#if defined(GRAVERLET_SIMD_AVX)
+  inline float horizontalSum(__m256 v)
+  {
+    const __m128 s = _mm_add_ps(_mm256_castps256_ps128(v), _mm256_extractf128_ps(v, 1));
+    const __m128 s2 = _mm_add_ps(s, _mm_movehl_ps(s, s));
+    return _mm_cvtss_f32(_mm_add_ss(s2, _mm_shuffle_ps(s2, s2, 1)));
+  }
+#elif defined(GRAVERLET_SIMD_SSE)
+  inline float horizontalSum(__m128 v)
+  {
+    const __m128 s = _mm_add_ps(v, _mm_movehl_ps(v, v));
+    return _mm_cvtss_f32(_mm_add_ss(s, _mm_shuffle_ps(s, s, 1)));
+  }
+#endif
+
+  // Sums sum_j m_j (p_i - p_j) / r^3 into (sx, sy) and sum_j m_j / r into sp for j in [jBegin, jEnd), p_i = (xi, yi).
+  // x, y and m have to be aligned to ParticleStore::alignment at index 0, jBegin and jEnd multiples of ParticleStore::lanes.
+  inline void sumBlock(const float *x, const float *y, const float *m, float xi, float yi, std::size_t jBegin, std::size_t jEnd, float softening, float &sx, float &sy, float &sp)
+  {
+#if defined(GRAVERLET_SIMD_AVX)
+    const __m256 xiv = _mm256_set1_ps(xi);
+    const __m256 yiv = _mm256_set1_ps(yi);
+    const __m256 eps = _mm256_set1_ps(softening);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 zero = _mm256_setzero_ps();
+    __m256 accX = _mm256_setzero_ps();
+    __m256 accY = _mm256_setzero_ps();
+    __m256 accP = _mm256_setzero_ps();
+    for (std::size_t j = jBegin; j < jEnd; j += 8)
+    {
+      const __m256 dx = _mm256_sub_ps(xiv, _mm256_load_ps(x + j));
+      const __m256 dy = _mm256_sub_ps(yiv, _mm256_load_ps(y + j));
+#if defined(__FMA__)
+      const __m256 r2 = _mm256_fmadd_ps(dx, dx, _mm256_fmadd_ps(dy, dy, eps));
+#else
+      const __m256 r2 = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy)), eps);
+#endif
+      // exact sqrt and division instead of _mm256_rsqrt_ps, energies are plotted and its 12 bits are visible there.
+      // Lanes with r2 == 0 get all bits cleared, their inf becomes 0.
+      const __m256 invR = _mm256_and_ps(_mm256_div_ps(one, _mm256_sqrt_ps(r2)), _mm256_cmp_ps(r2, zero, _CMP_GT_OQ));
+      const __m256 mInvR = _mm256_mul_ps(_mm256_load_ps(m + j), invR);
+      const __m256 mInvR3 = _mm256_mul_ps(mInvR, _mm256_mul_ps(invR, invR));
+      accX = _mm256_add_ps(accX, _mm256_mul_ps(dx, mInvR3));
+      accY = _mm256_add_ps(accY, _mm256_mul_ps(dy, mInvR3));
+      accP = _mm256_add_ps(accP, mInvR);
+    }
+    sx += horizontalSum(accX);
+    sy += horizontalSum(accY);
+    sp += horizontalSum(accP);
+#elif defined(GRAVERLET_SIMD_SSE)
+    const __m128 xiv = _mm_set1_ps(xi);
+    const __m128 yiv = _mm_set1_ps(yi);
+    const __m128 eps = _mm_set1_ps(softening);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 zero = _mm_setzero_ps();
+    __m128 accX = _mm_setzero_ps();
+    __m128 accY = _mm_setzero_ps();
+    __m128 accP = _mm_setzero_ps();
+    for (std::size_t j = jBegin; j < jEnd; j += 4)
+    {
+      const __m128 dx = _mm_sub_ps(xiv, _mm_load_ps(x + j));
+      const __m128 dy = _mm_sub_ps(yiv, _mm_load_ps(y + j));
+      const __m128 r2 = _mm_add_ps(_mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy)), eps);
+      const __m128 invR = _mm_and_ps(_mm_div_ps(one, _mm_sqrt_ps(r2)), _mm_cmpgt_ps(r2, zero));
+      const __m128 mInvR = _mm_mul_ps(_mm_load_ps(m + j), invR);
+      const __m128 mInvR3 = _mm_mul_ps(mInvR, _mm_mul_ps(invR, invR));
+      accX = _mm_add_ps(accX, _mm_mul_ps(dx, mInvR3));
+      accY = _mm_add_ps(accY, _mm_mul_ps(dy, mInvR3));
+      accP = _mm_add_ps(accP, mInvR);
+    }
+    sx += horizontalSum(accX);
+    sy += horizontalSum(accY);
+    sp += horizontalSum(accP);
+#else
+    float accX{}, accY{}, accP{};
+    for (std::size_t j = jBegin; j < jEnd; ++j)
+    {
+      const float dx = xi - x[j];
+      const float dy = yi - y[j];
+      const float r2 = dx * dx + dy * dy + softening;
+      const float invR = r2 > 0.0f ? 1.0f / std::sqrt(r2) : 0.0f;
+      const float mInvR = m[j] * invR;
+      const float mInvR3 = mInvR * invR * invR;
+      accX += dx * mInvR3;
+      accY += dy * mInvR3;
+      accP += mInvR;
+    }
+    sx += accX;
+    sy += accY;
+    sp += accP;
+#endif
+  }
+
+  // Generic counterpart of sumBlock() for any law: sums m_j forceScale (p_i - p_j) into (sx, sy) and m_j potential into sp.
+  template <typename Law>
+  inline void sumBlockGeneric(const float *x, const float *y, const float *m, const Law &law, float xi, float yi, std::size_t jBegin, std::size_t jEnd, float &sx, float &sy, float &sp)
+  {
+    float accX{}, accY{}, accP{};
+    for (std::size_t j = jBegin; j < jEnd; ++j)
+    {
+      const float dx = xi - x[j];
+      const float dy = yi - y[j];
+      const forcelaw::PairTerms t = law.evaluate(dx * dx + dy * dy);
+      accX += m[j] * t.forceScale * dx;
+      accY += m[j] * t.forceScale * dy;
+      accP += m[j] * t.potential;
+    }
+    sx += accX;
+    sy += accY;
+    sp += accP;
+  }
+
+  // Accumulates accelerations of targets [iBegin, iEnd) due to all particles into ps.ax/ay and returns their potential.
+  template <typename Law>
+  inline double accumulateAccelerations(ParticleStore &ps, const Law &law, std::size_t iBegin, std::size_t iEnd)
+  {
+    double potential{};
+    const std::size_t n = ps.paddedSize();
+    // j-blocks outermost: a block is loaded into L1 once and reused by every target
+    for (std::size_t jBegin = 0; jBegin < n; jBegin += jBlockSize)
+    {
+      const std::size_t jEnd = std::min(jBegin + jBlockSize, n);
+      for (std::size_t i = iBegin; i < iEnd; ++i)
+      {
+        float sx{}, sy{}, sp{};
+        if constexpr (requires { law.softening2(); })
+        {
+          sumBlock(ps.x.data(), ps.y.data(), ps.mass.data(), ps.x[i], ps.y[i], jBegin, jEnd, law.softening2(), sx, sy, sp);
+          ps.ax[i] -= law.G * sx;
+          ps.ay[i] -= law.G * sy;
+          potential -= static_cast<double>(law.G) * ps.mass[i] * sp;
+        }
+        else
+        {
+          sumBlockGeneric(ps.x.data(), ps.y.data(), ps.mass.data(), law, ps.x[i], ps.y[i], jBegin, jEnd, sx, sy, sp);
+          ps.ax[i] += sx;
+          ps.ay[i] += sy;
+          potential += static_cast<double>(ps.mass[i]) * sp;
+        }
+      }
+    }
+    return potential;
+  }
+
+  // Mixed precision variant of accumulateAccelerations() over a MixedParticleStore, accumulating into ps.ax/ay of the
+  // targets targets[0, numTargets). The pair kernel runs in float on positions relative to a local origin, the center of
+  // the targets' bounding box, so that the differences p_i - p_j of nearby pairs keep their precision however far they
+  // are from the world origin. That takes targets close to each other, e.g. a run of a Z-order sort. Sums over a source
+  // block stay in float (jBlockSize / lanes terms per SIMD lane), sums over blocks and the potential are in double.
+  // Self-pairs are masked out of the float sums and their constant potential added in double: for the Sun that term is
+  // ~10^8 times a planet's and would round the planets' contributions away.
+  template <typename Law>
+  inline double accumulateAccelerationsMixed(MixedParticleStore &ps, const Law &law, const uint32_t *targets, std::size_t numTargets)
+  {
+    alignas(ParticleStore::alignment) float relX[jBlockSize];
+    alignas(ParticleStore::alignment) float relY[jBlockSize];
+    alignas(ParticleStore::alignment) float blockMass[jBlockSize];
+    if (numTargets == 0)
+      return 0.0;
+    double minX = ps.x[targets[0]], maxX = minX;
+    double minY = ps.y[targets[0]], maxY = minY;
+    for (std::size_t t = 1; t < numTargets; ++t)
+    {
+      minX = std::min(minX, ps.x[targets[t]]);
+      maxX = std::max(maxX, ps.x[targets[t]]);
+      minY = std::min(minY, ps.y[targets[t]]);
+      maxY = std::max(maxY, ps.y[targets[t]]);
+    }
+    const double originX = 0.5 * (minX + maxX);
+    const double originY = 0.5 * (minY + maxY);
+    double potential{};
+    const std::size_t n = ps.paddedSize();
+    for (std::size_t jBegin = 0; jBegin < n; jBegin += jBlockSize)
+    {
+      const std::size_t jEnd = std::min(jBegin + jBlockSize, n);
+      for (std::size_t j = jBegin; j < jEnd; ++j)
+      {
+        relX[j - jBegin] = static_cast<float>(ps.x[j] - originX);
+        relY[j - jBegin] = static_cast<float>(ps.y[j] - originY);
+        blockMass[j - jBegin] = ps.mass[j];
+      }
+      for (std::size_t t = 0; t < numTargets; ++t)
+      {
+        const std::size_t i = targets[t];
+        const float xi = static_cast<float>(ps.x[i] - originX);
+        const float yi = static_cast<float>(ps.y[i] - originY);
+        const bool isInBlock = i >= jBegin && i < jEnd;
+        if (isInBlock)
+          blockMass[i - jBegin] = 0.0f;
+        float sx{}, sy{}, sp{};
+        if constexpr (requires { law.softening2(); })
+        {
+          sumBlock(relX, relY, blockMass, xi, yi, 0, jEnd - jBegin, law.softening2(), sx, sy, sp);
+          ps.ax[i] -= static_cast<double>(law.G) * sx;
+          ps.ay[i] -= static_cast<double>(law.G) * sy;
+          potential -= static_cast<double>(law.G) * ps.mass[i] * sp;
+        }
+        else
+        {
+          sumBlockGeneric(relX, relY, blockMass, law, xi, yi, 0, jEnd - jBegin, sx, sy, sp);
+          ps.ax[i] += sx;
+          ps.ay[i] += sy;
+          potential += static_cast<double>(ps.mass[i]) * sp;
+        }
+        if (isInBlock)
+          blockMass[i - jBegin] = ps.mass[i];
+      }
+    }
+    // self-pairs exert no force
+    const double selfPotential = law.evaluate(0.0f).potential;
+    for (std::size_t t = 0; t < numTargets; ++t)
+      potential += selfPotential * ps.mass[targets[t]] * ps.mass[targets[t]];
+    return potential;
+  }
+} // namespace gravity
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "Integrators.h"
+#include "Verlet.h"
+
+#include <ThreadPool.h>
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <variant>
+#include <vector>
+
+// Energy drift versus force evaluations of the integrator::schemes on a given initial condition.
+struct IntegratorBenchmarkResult
+{
+  const char *scenario;
+  const char *scheme;
+  int stepsPerDay;
+  double forceEvaluationsPerDay;
+  // max over the run of |E(t) - E(0)| / |E(0)|, sampled once per simulated day
+  double maxEnergyDrift;
+  double seconds;
+};
+
+// Total energy in double precision over unordered pairs, i.e. without the self-pair terms Solver reports by convention.
+// Those are constant but can be orders of magnitude larger than the rest and would hide the drift.
+inline double conservedEnergy(const std::vector<VerletObject> &objects, const ForceLaw &forceLaw)
+{
+  const auto evaluate = [&](const auto &law)
+  {
+    double energy{};
+    for (size_t i = 0; i < objects.size(); ++i)
+    {
+      const VerletObject &o1 = objects[i];
+      energy += 0.5 * o1.mass * glm::dot(o1.vel, o1.vel);
+      for (size_t j = i + 1; j < objects.size(); ++j)
+      {
+        const VerletObject &o2 = objects[j];
+        const glm::vec2 r = o1.pos - o2.pos;
+        energy += static_cast<double>(o1.mass) * o2.mass * law.evaluate(glm::dot(r, r)).potential;
+      }
+    }
+    return energy;
+  };
+  return std::visit(evaluate, forceLaw);
+}
+
+// Runs every scheme with each of the given step counts per day for `days` days of exact forces and appends a result per run.
+inline void benchmarkIntegrators(const char *scenario, const std::vector<VerletObject> &initialObjects, const ForceLaw &forceLaw,
+                                 int days, const std::vector<int> &stepsPerDay, ws::ThreadPool *threadPool,
+                                 std::vector<IntegratorBenchmarkResult> &results)
+{
+  const double initialEnergy = conservedEnergy(initialObjects, forceLaw);
+  for (const integrator::Scheme &scheme : integrator::schemes)
+    for (int steps : stepsPerDay)
+    {
+      std::vector<VerletObject> objects = initialObjects;
+      Solver solver(objects, forceLaw);
+      solver.threadPool = threadPool;
+      solver.integrationScheme = scheme;
+
+      size_t numForceEvaluations{};
+      double maxEnergyDrift{};
+      const auto start = std::chrono::steady_clock::now();
+      for (int day = 0; day < days; ++day)
+      {
+        solver.update(1.0f, steps);
+        numForceEvaluations += solver.numForceEvaluations;
+        const double drift = std::abs((conservedEnergy(objects, forceLaw) - initialEnergy) / initialEnergy);
+        maxEnergyDrift = std::max(maxEnergyDrift, drift);
+      }
+      const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+
+      const double evaluationsPerDay = static_cast<double>(numForceEvaluations) / (static_cast<double>(days) * std::max<size_t>(objects.size(), 1));
+      results.push_back({scenario, scheme.name, steps, evaluationsPerDay, maxEnergyDrift, duration.count()});
+    }
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <array>
+
+// Symplectic integrators written as splitting schemes, i.e. alternating drifts and kicks of a step h:
+//   v += firstKick a h
+//   for each stage k: x += drifts[k] v h, a = f(x) / m, v += kicks[k] a h
+// firstKick uses the acceleration at the end of the previous step ("first same as last"), hence a scheme needs one force
+// evaluation per stage with a non-zero kick. Position-form schemes end with a drift (zero last kick), their final
+// acceleration is only computed when energies are wanted.
+// Coefficients: https://en.wikipedia.org/wiki/Symplectic_integrator
+//   Yoshida (1990), "Construction of higher order symplectic integrators"
+//   Forest & Ruth (1990), "Fourth-order symplectic integration"
+//   Omelyan, Mryglod & Folk (2002), "Optimized Forest-Ruth- and Suzuki-like algorithms for integration of motion in many-body systems"
+namespace integrator
+{
+  inline constexpr int maxStages = 5;
+
+  struct Scheme
+  {
+    const char *name;
+    int order;
+    int numStages;
+    float firstKick;
+    std::array<float, maxStages> drifts;
+    std::array<float, maxStages> kicks;
+  };
+
+  // 1 / (2 - 2^(1/3)) and 1 - 2 w1 = -2^(1/3) w1, weights of the triple jump composition of a 2nd order scheme
+  inline constexpr float w1 = 1.3512071919596576f;
+  inline constexpr float w0 = -1.7024143839193153f;
+
+  // kick-drift-kick leapfrog, what Solver used to hard-code
+  inline constexpr Scheme velocityVerlet{"Velocity Verlet", 2, 1, 0.5f, {1.0f}, {0.5f}};
+
+  // triple jump of velocity Verlet with steps w1 h, w0 h, w1 h
+  inline constexpr Scheme yoshida4{"Yoshida 4", 4, 3, 0.5f * w1, {w1, w0, w1}, {0.5f * (w1 + w0), 0.5f * (w0 + w1), 0.5f * w1}};
+
+  // the same triple jump in position form (drift-kick-drift)
+  inline constexpr Scheme forestRuth{"Forest-Ruth", 4, 4, 0.0f, {0.5f * w1, 0.5f * (w0 + w1), 0.5f * (w0 + w1), 0.5f * w1}, {w1, w0, w1, 0.0f}};
+
+  // position extended Forest-Ruth like, 4 force evaluations per step but ~100x smaller error constant than Forest-Ruth
+  inline constexpr float pefrlXi = 0.1786178958448091f;
+  inline constexpr float pefrlLambda = -0.2123418310626054f;
+  inline constexpr float pefrlChi = -0.06626458266981849f;
+  inline constexpr Scheme pefrl{"PEFRL", 4, 5, 0.0f, {pefrlXi, pefrlChi, 1.0f - 2.0f * (pefrlChi + pefrlXi), pefrlChi, pefrlXi}, {0.5f * (1.0f - 2.0f * pefrlLambda), pefrlLambda, pefrlLambda, 0.5f * (1.0f - 2.0f * pefrlLambda), 0.0f}};
+
+  inline constexpr std::array<Scheme, 4> schemes = {velocityVerlet, yoshida4, forestRuth, pefrl};
+
+  // force evaluations per step when the final acceleration is not needed
+  constexpr int forceEvaluationsPerStep(const Scheme &scheme)
+  {
+    int count = 0;
+    for (int k = 0; k < scheme.numStages; ++k)
+      count += scheme.kicks[k] != 0.0f;
+    return count;
+  }
+} // namespace integrator
@@ -0,0 +1,183 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <MortonOrder.h>
+
+#include <glm/vec2.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <new>
+#include <vector>
+
+// Minimal allocator for std::vector whose storage starts at an Alignment byte boundary, so that SIMD loads can be aligned.
+template <typename T, std::size_t Alignment>
+struct AlignedAllocator
+{
+  using value_type = T;
+
+  template <typename U>
+  struct rebind
+  {
+    using other = AlignedAllocator<U, Alignment>;
+  };
+
+  AlignedAllocator() = default;
+  template <typename U>
+  AlignedAllocator(const AlignedAllocator<U, Alignment> &) {}
+
+  T *allocate(std::size_t n)
+  {
+    return static_cast<T *>(::operator new(n * sizeof(T), std::align_val_t{Alignment}));
+  }
+
+  void deallocate(T *p, std::size_t)
+  {
+    ::operator delete(p, std::align_val_t{Alignment});
+  }
+
+  template <typename U>
+  bool operator==(const AlignedAllocator<U, Alignment> &) const { return true; }
+  template <typename U>
+  bool operator!=(const AlignedAllocator<U, Alignment> &) const { return false; }
+};
+
+// Structure-of-arrays copy of a std::vector<VerletObject>.
+// Arrays are cache-line aligned and padded to a multiple of `lanes` with massless particles,
+// so that kernels can process them in full SIMD registers without a remainder loop.
+class ParticleStore
+{
+public:
+  static constexpr std::size_t alignment = 64;
+  // 8 floats = one AVX register
+  static constexpr std::size_t lanes = 8;
+
+  using FloatArray = std::vector<float, AlignedAllocator<float, alignment>>;
+
+  FloatArray x, y;
+  FloatArray vx, vy;
+  FloatArray ax, ay;
+  FloatArray mass;
+
+  // number of actual particles, arrays are paddedSize() long
+  std::size_t size() const { return count; }
+  std::size_t paddedSize() const { return x.size(); }
+
+  void resize(std::size_t n)
+  {
+    count = n;
+    const std::size_t padded = (n + lanes - 1) / lanes * lanes;
+    for (FloatArray *arr : {&x, &y, &vx, &vy, &ax, &ay, &mass})
+      arr->assign(padded, 0.0f);
+  }
+
+  void load(const std::vector<VerletObject> &objects)
+  {
+    resize(objects.size());
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const VerletObject &obj = objects[i];
+      x[i] = obj.pos.x;
+      y[i] = obj.pos.y;
+      vx[i] = obj.vel.x;
+      vy[i] = obj.vel.y;
+      ax[i] = obj.acc.x;
+      ay[i] = obj.acc.y;
+      mass[i] = obj.mass;
+    }
+  }
+
+  // radius (and anything else not needed for dynamics) is left untouched
+  void store(std::vector<VerletObject> &objects) const
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      VerletObject &obj = objects[i];
+      obj.pos = {x[i], y[i]};
+      obj.vel = {vx[i], vy[i]};
+      obj.acc = {ax[i], ay[i]};
+    }
+  }
+
+private:
+  std::size_t count{};
+};
+
+// Double precision counterpart of ParticleStore for Solver::updateMixedPrecision(). Positions, velocities and
+// accelerations are integrated in double and kept across updates, objects only get their float rounding.
+// load() takes the values of an object only if they differ from what store() gave it, i.e. when the object was moved
+// by something else (another solver, a new setup), so that the extra precision is not rounded away every frame.
+class MixedParticleStore
+{
+public:
+  std::vector<double> x, y;
+  std::vector<double> vx, vy;
+  std::vector<double> ax, ay;
+  // padded with zeros like ParticleStore, read by the float pair kernel
+  ParticleStore::FloatArray mass;
+
+  std::size_t size() const { return count; }
+  std::size_t paddedSize() const { return x.size(); }
+
+  void load(const std::vector<VerletObject> &objects)
+  {
+    const bool isNew = objects.size() != count;
+    if (isNew)
+    {
+      count = objects.size();
+      const std::size_t padded = (count + ParticleStore::lanes - 1) / ParticleStore::lanes * ParticleStore::lanes;
+      for (std::vector<double> *arr : {&x, &y, &vx, &vy, &ax, &ay})
+        arr->assign(padded, 0.0);
+      mass.assign(padded, 0.0f);
+      storedPos.resize(count);
+      storedVel.resize(count);
+    }
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      const VerletObject &obj = objects[i];
+      mass[i] = obj.mass;
+      if (!isNew && obj.pos == storedPos[i] && obj.vel == storedVel[i])
+        continue;
+      x[i] = obj.pos.x;
+      y[i] = obj.pos.y;
+      vx[i] = obj.vel.x;
+      vy[i] = obj.vel.y;
+      ax[i] = obj.acc.x;
+      ay[i] = obj.acc.y;
+    }
+  }
+
+  // Follows a permutation of the objects, old moves to remap[old], so that the next load() keeps the double state.
+  // Another number of objects is reloaded from scratch anyway.
+  void permute(const std::vector<uint32_t> &remap)
+  {
+    if (remap.size() != count)
+      return;
+    for (std::vector<double> *arr : {&x, &y, &vx, &vy, &ax, &ay})
+      ws::permuteByRemap(*arr, remap);
+    ws::permuteByRemap(mass, remap);
+    ws::permuteByRemap(storedPos, remap);
+    ws::permuteByRemap(storedVel, remap);
+  }
+
+  void store(std::vector<VerletObject> &objects)
+  {
+    for (std::size_t i = 0; i < count; ++i)
+    {
+      VerletObject &obj = objects[i];
+      obj.pos = {static_cast<float>(x[i]), static_cast<float>(y[i])};
+      obj.vel = {static_cast<float>(vx[i]), static_cast<float>(vy[i])};
+      obj.acc = {static_cast<float>(ax[i]), static_cast<float>(ay[i])};
+      storedPos[i] = obj.pos;
+      storedVel[i] = obj.vel;
+    }
+  }
+
+private:
+  std::size_t count{};
+  // what store() wrote into the objects
+  std::vector<glm::vec2> storedPos;
+  std::vector<glm::vec2> storedVel;
+};
@@ -0,0 +1,180 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// Barnes-Hut tree over VerletObject positions
+// https://en.wikipedia.org/wiki/Barnes%E2%80%93Hut_simulation
+// Nodes live in a flat vector that keeps its capacity between rebuilds, so building it every substep does not allocate.
+class QuadTree
+{
+public:
+  struct Node
+  {
+    glm::vec2 center{};
+    float halfSize{};
+    // monopole: center of mass and total mass of all objects under the node
+    glm::vec2 com{};
+    float mass{};
+    // index of the first of 4 consecutive children, -1 for leaves
+    int32_t firstChild = -1;
+    // leaves: head of the linked list of object indices (see next), -1 if empty
+    int32_t firstObject = -1;
+  };
+
+  std::vector<Node> nodes;
+  // next[objIx] is the index of the next object in the same leaf, -1 at the end of the list
+  std::vector<int32_t> next;
+
+  // objects closer than this are kept in the same leaf instead of being split further
+  static constexpr int maxDepth = 24;
+
+  void build(const std::vector<VerletObject> &objects)
+  {
+    nodes.clear();
+    next.assign(objects.size(), -1);
+    if (objects.empty())
+      return;
+
+    glm::vec2 minPos{std::numeric_limits<float>::max()};
+    glm::vec2 maxPos{std::numeric_limits<float>::lowest()};
+    for (const auto &obj : objects)
+    {
+      minPos = glm::min(minPos, obj.pos);
+      maxPos = glm::max(maxPos, obj.pos);
+    }
+    const glm::vec2 extent = maxPos - minPos;
+    // slightly larger than the bounding box so that objects on the max edges fall inside
+    const float halfSize = std::max(std::max(extent.x, extent.y) * 0.5f * 1.001f, 1e-6f);
+    nodes.push_back(Node{(minPos + maxPos) * 0.5f, halfSize});
+
+    for (int32_t ix = 0; ix < static_cast<int32_t>(objects.size()); ++ix)
+      insert(objects, ix);
+
+    // children are always created after their parent, hence a reverse sweep visits them first
+    for (int32_t nIx = static_cast<int32_t>(nodes.size()) - 1; nIx >= 0; --nIx)
+    {
+      Node &node = nodes[nIx];
+      glm::vec2 weightedPos{};
+      float mass{};
+      if (node.firstChild == -1)
+        for (int32_t ix = node.firstObject; ix != -1; ix = next[ix])
+        {
+          weightedPos += objects[ix].pos * objects[ix].mass;
+          mass += objects[ix].mass;
+        }
+      else
+        for (int32_t c = node.firstChild; c < node.firstChild + 4; ++c)
+        {
+          weightedPos += nodes[c].com * nodes[c].mass;
+          mass += nodes[c].mass;
+        }
+      node.mass = mass;
+      node.com = mass > 0 ? weightedPos / mass : node.center;
+    }
+  }
+
+  // Calls onObject(const VerletObject &) for objects in leaves that are too close to be approximated
+  // and onNode(const VerletObject &) with the monopole of far nodes, those for which size / distance < theta.
+  template <typename OnObject, typename OnNode>
+  void traverse(const std::vector<VerletObject> &objects, const glm::vec2 &pos, float theta, OnObject &&onObject, OnNode &&onNode) const
+  {
+    if (nodes.empty())
+      return;
+    const float theta2 = theta * theta;
+    // each level pushes at most 4 children after popping their parent
+    std::array<int32_t, 3 * maxDepth + 4> stack;
+    int top = 0;
+    stack[top++] = 0;
+    while (top > 0)
+    {
+      const Node &node = nodes[stack[--top]];
+      if (node.mass == 0)
+        continue;
+
+      if (node.firstChild == -1)
+      {
+        for (int32_t ix = node.firstObject; ix != -1; ix = next[ix])
+          onObject(objects[ix]);
+        continue;
+      }
+
+      const glm::vec2 d = pos - node.com;
+      const float size = 2.0f * node.halfSize;
+      // never approximate a node that contains the query point, its COM can be arbitrarily close to it
+      const bool isInside = std::abs(pos.x - node.center.x) <= node.halfSize && std::abs(pos.y - node.center.y) <= node.halfSize;
+      if (!isInside && size * size < theta2 * glm::dot(d, d))
+      {
+        onNode(VerletObject{node.com, {}, node.mass, node.halfSize, {}});
+        continue;
+      }
+
+      for (int32_t c = node.firstChild; c < node.firstChild + 4; ++c)
+        stack[top++] = c;
+    }
+  }
+
+private:
+  int32_t quadrantOf(const Node &node, const glm::vec2 &pos) const
+  {
+    return (pos.x >= node.center.x ? 1 : 0) + (pos.y >= node.center.y ? 2 : 0);
+  }
+
+  void subdivide(int32_t nIx)
+  {
+    const float h = nodes[nIx].halfSize * 0.5f;
+    const glm::vec2 c = nodes[nIx].center;
+    const int32_t firstChild = static_cast<int32_t>(nodes.size());
+    // order matches quadrantOf()
+    nodes.push_back(Node{c + glm::vec2{-h, -h}, h});
+    nodes.push_back(Node{c + glm::vec2{+h, -h}, h});
+    nodes.push_back(Node{c + glm::vec2{-h, +h}, h});
+    nodes.push_back(Node{c + glm::vec2{+h, +h}, h});
+    // push_back might have reallocated, don't hold references to nodes across it
+    nodes[nIx].firstChild = firstChild;
+  }
+
+  void insert(const std::vector<VerletObject> &objects, int32_t objIx)
+  {
+    const glm::vec2 &pos = objects[objIx].pos;
+    int32_t nIx = 0;
+    int depth = 0;
+    while (true)
+    {
+      if (nodes[nIx].firstChild != -1)
+      {
+        nIx = nodes[nIx].firstChild + quadrantOf(nodes[nIx], pos);
+        ++depth;
+        continue;
+      }
+
+      if (nodes[nIx].firstObject == -1 || depth >= maxDepth)
+      {
+        next[objIx] = nodes[nIx].firstObject;
+        nodes[nIx].firstObject = objIx;
+        return;
+      }
+
+      // occupied leaf: push its objects one level down and try again
+      int32_t ix = nodes[nIx].firstObject;
+      nodes[nIx].firstObject = -1;
+      subdivide(nIx);
+      while (ix != -1)
+      {
+        const int32_t nextIx = next[ix];
+        const int32_t cIx = nodes[nIx].firstChild + quadrantOf(nodes[nIx], objects[ix].pos);
+        next[ix] = nodes[cIx].firstObject;
+        nodes[cIx].firstObject = ix;
+        ix = nextIx;
+      }
+    }
+  }
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <glm/vec2.hpp>
+#include <glm/geometric.hpp>
+
+#include <cmath>
+#include <random>
+#include <vector>
+
+// Units: https://gandalfcode.github.io/gandalf-school/Units.pdf, see main.cpp
+namespace constants
+{
+  // T0: 1 day in seconds
+  inline const float T0 = 24 * 60 * 60;
+
+  // M0: Earth's mass in kg
+  // https://en.wikipedia.org/wiki/Earth_mass
+  inline const float M0 = 5.972e24f;
+
+  // R0: // distance from earth to sun in meters = 1 AU = 150 Mkm (varies 3% throughout the year)
+  // https://en.wikipedia.org/wiki/Astronomical_unit
+  inline const float R0 = 150e9f;
+
+  // G: gravitational constant G in m^3 / kg s^2
+  // https://en.wikipedia.org/wiki/Gravitational_constant
+  inline const float GG = 6.674e-11f;
+
+  // G0: unitless gravitational constant = 8.81576e-10
+  inline const float G0 = GG * M0 * std::pow(T0, 2.f) / std::pow(R0, 3.f);
+
+  inline const float R_AU = 1.0f;
+
+  inline const float M_Earth = 1.0f;
+
+  // Sun's mass is 333030 M0
+  inline const float M_Sun = 333030.0f;
+
+  // Earth's speed = 29.78 km/s
+  // https://en.wikipedia.org/wiki/Earth%27s_orbit
+  inline const float V_Earth_Sun = 2.978e4f * T0 / R0;
+
+  // Moon's speed around Earth: 1.022km/s
+  // https://en.wikipedia.org/wiki/Orbit_of_the_Moon
+  inline const float V_Moon_Earth = 1022 * T0 / R0;
+  inline const float R_Moon_Earth = 0.00257f;
+  inline const float M_Moon = 1.0f / 82;
+} // namespace constants
+
+// Initial conditions shared by the app and the benchmarks
+namespace scenarios
+{
+  inline std::vector<VerletObject> sunEarthMoon()
+  {
+    std::vector<VerletObject> objects;
+    // Add sun
+    objects.emplace_back(VerletObject{{0, 0}, {0, 0}, constants::M_Sun, 0.05f, {}});
+    // Add earth
+    objects.emplace_back(VerletObject{{constants::R_AU, 0}, {0, constants::V_Earth_Sun}, constants::M_Earth, 0.002f, {}});
+    // Add moon
+    objects.emplace_back(VerletObject{{constants::R_AU - constants::R_Moon_Earth, 0}, {0, constants::V_Earth_Sun - constants::V_Moon_Earth}, constants::M_Moon, 0.0002f, {}});
+
+    // Earth+Moon only
+    // objects.emplace_back(VerletObject{{0, 0}, {0, 0}, constants::M_Earth, 0.002f, {}});
+    // objects.emplace_back(VerletObject{{0.00257, 0}, {0, constants::V_Moon}, 1.0f / 82, 0.0002f, {}});
+    return objects;
+  }
+
+  // Sun and numObjects planets on circular orbits (scaled by speedFactor) at uniformly random distances within 1 AU
+  inline std::vector<VerletObject> sunWithPlanets(int numObjects, float speedFactor, std::mt19937 &rndGen, std::uniform_real_distribution<float> &rndDist)
+  {
+    std::vector<VerletObject> objects;
+    objects.emplace_back(VerletObject{{0, 0}, {0, 0}, constants::M_Sun, 0.05f, {}});
+    for (int n = 0; n < numObjects; n++)
+    {
+      const float r = constants::R_AU * rndDist(rndGen);
+      glm::vec2 p{};
+      {
+        const float theta = 2.0f * 3.14159265f * rndDist(rndGen);
+        const float x = r * std::cos(theta);
+        const float y = r * std::sin(theta);
+        p = {x, y};
+      }
+      glm::vec2 v{};
+      {
+        const float speed = constants::V_Earth_Sun / std::sqrt(r);
+        v = glm::normalize(glm::vec2{-p.y, p.x}) * speed * speedFactor;
+      }
+
+      objects.emplace_back(VerletObject{p, v, 1.5f, 0.01f});
+    }
+    return objects;
+  }
+} // namespace scenarios
@@ -0,0 +1,345 @@
+#include "Trajectory.h"
+
+#include "Scenarios.h"
+
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace trajectory
+{
+  size_t Layout::numFramesIn(size_t fileSize) const
+  {
+    if (fileSize < dataOffset())
+      return 0;
+    const size_t dataBytes = fileSize - dataOffset();
+    if (encoding != Encoding::Delta16)
+      return dataBytes / frameBytes(true);
+    const size_t groupBytes = frameBytes(true) + (keyframeInterval - 1) * frameBytes(false);
+    const size_t rest = dataBytes % groupBytes;
+    const size_t inLastGroup = rest < frameBytes(true) ? 0 : 1 + (rest - frameBytes(true)) / frameBytes(false);
+    return dataBytes / groupBytes * keyframeInterval + inLastGroup;
+  }
+
+  Recorder::~Recorder()
+  {
+    close();
+  }
+
+  bool Recorder::open(const std::filesystem::path &path, const std::vector<VerletObject> &objects, Encoding encoding, uint32_t keyframeInterval)
+  {
+    close();
+    file = std::fopen(path.string().c_str(), "wb");
+    if (file == nullptr)
+    {
+      std::cerr << "error creating trajectory file " << path.string() << "\n";
+      return false;
+    }
+
+    header = Header{};
+    header.encoding = encoding;
+    header.numObjects = objects.size();
+    header.keyframeInterval = encoding == Encoding::Delta16 ? std::max(keyframeInterval, 1u) : 1u;
+    header.T0 = constants::T0;
+    header.M0 = constants::M0;
+    header.R0 = constants::R0;
+    header.GG = constants::GG;
+    header.G0 = constants::G0;
+    layout = {header.encoding, header.numObjects, header.keyframeInterval};
+
+    std::vector<float> attributes;
+    attributes.reserve(2 * objects.size());
+    for (const VerletObject &obj : objects)
+    {
+      attributes.push_back(obj.mass);
+      attributes.push_back(obj.radius);
+    }
+    std::fwrite(&header, sizeof(header), 1, file);
+    std::fwrite(attributes.data(), sizeof(float), attributes.size(), file);
+    bytesWritten = sizeof(header) + attributes.size() * sizeof(float);
+
+    numFrames = 0;
+    numDroppedFrames = 0;
+    reconstructed.assign(objects.size(), {});
+    stopping = false;
+    writer = std::thread(&Recorder::writerLoop, this);
+    return true;
+  }
+
+  bool Recorder::record(const std::vector<VerletObject> &objects, double time)
+  {
+    if (!isOpen() || objects.size() != layout.numObjects)
+      return false;
+
+    std::vector<uint8_t> buffer;
+    {
+      std::lock_guard lock(mutex);
+      if (queue.size() >= maxQueuedFrames)
+      {
+        ++numDroppedFrames;
+        return false;
+      }
+      if (!freeBuffers.empty())
+      {
+        buffer = std::move(freeBuffers.back());
+        freeBuffers.pop_back();
+      }
+    }
+
+    const bool isKeyframe = layout.isKeyframe(numFrames);
+    buffer.resize(layout.frameBytes(isKeyframe));
+    const FrameHeader frameHeader{time, isKeyframe ? 1u : 0u, 0};
+    std::memcpy(buffer.data(), &frameHeader, sizeof(frameHeader));
+    uint8_t *data = buffer.data() + sizeof(FrameHeader);
+    const size_t n = objects.size();
+    if (layout.encoding == Encoding::Float32 || (layout.encoding == Encoding::Delta16 && isKeyframe))
+    {
+      float *values = reinterpret_cast<float *>(data);
+      for (size_t ix = 0; ix < n; ++ix, values += 4)
+      {
+        const VerletObject &obj = objects[ix];
+        values[0] = obj.pos.x;
+        values[1] = obj.pos.y;
+        values[2] = obj.vel.x;
+        values[3] = obj.vel.y;
+        reconstructed[ix] = {obj.pos.x, obj.pos.y, obj.vel.x, obj.vel.y};
+      }
+    }
+    else if (layout.encoding == Encoding::Float16)
+    {
+      uint16_t *values = reinterpret_cast<uint16_t *>(data);
+      for (size_t ix = 0; ix < n; ++ix, values += 4)
+      {
+        const VerletObject &obj = objects[ix];
+        values[0] = floatToHalf(obj.pos.x);
+        values[1] = floatToHalf(obj.pos.y);
+        values[2] = floatToHalf(obj.vel.x);
+        values[3] = floatToHalf(obj.vel.y);
+      }
+    }
+    else
+    {
+      uint16_t *values = reinterpret_cast<uint16_t *>(data);
+      for (size_t ix = 0; ix < n; ++ix, values += 4)
+      {
+        const glm::vec4 current{objects[ix].pos.x, objects[ix].pos.y, objects[ix].vel.x, objects[ix].vel.y};
+        glm::vec4 &prev = reconstructed[ix];
+        for (int c = 0; c < 4; ++c)
+        {
+          values[c] = floatToHalf(current[c] - prev[c]);
+          // the same addition the player does
+          prev[c] += halfToFloat(values[c]);
+        }
+      }
+    }
+    ++numFrames;
+
+    {
+      std::lock_guard lock(mutex);
+      queue.push_back(std::move(buffer));
+    }
+    queueChanged.notify_one();
+    return true;
+  }
+
+  void Recorder::close()
+  {
+    if (!isOpen())
+      return;
+    {
+      std::lock_guard lock(mutex);
+      stopping = true;
+    }
+    queueChanged.notify_one();
+    writer.join();
+
+    header.numFrames = numFrames;
+    std::fseek(file, 0, SEEK_SET);
+    std::fwrite(&header, sizeof(header), 1, file);
+    if (std::fclose(file) != 0)
+      std::cerr << "error writing trajectory file\n";
+    file = nullptr;
+    freeBuffers.clear();
+  }
+
+  size_t Recorder::getNumQueuedFrames() const
+  {
+    std::lock_guard lock(mutex);
+    return queue.size();
+  }
+
+  void Recorder::writerLoop()
+  {
+    bool hasFailed = false;
+    while (true)
+    {
+      std::vector<uint8_t> buffer;
+      {
+        std::unique_lock lock(mutex);
+        queueChanged.wait(lock, [this]
+                          { return stopping || !queue.empty(); });
+        if (queue.empty())
+          return;
+        buffer = std::move(queue.front());
+        queue.pop_front();
+      }
+
+      if (std::fwrite(buffer.data(), 1, buffer.size(), file) != buffer.size() && !hasFailed)
+      {
+        std::cerr << "error writing trajectory file\n";
+        hasFailed = true;
+      }
+      bytesWritten += buffer.size();
+
+      std::lock_guard lock(mutex);
+      freeBuffers.push_back(std::move(buffer));
+    }
+  }
+
+  MappedFile::~MappedFile()
+  {
+    close();
+  }
+
+  bool MappedFile::open(const std::filesystem::path &path)
+  {
+    close();
+#if defined(_WIN32)
+    HANDLE fh = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (fh == INVALID_HANDLE_VALUE)
+      return false;
+    LARGE_INTEGER fileSize{};
+    GetFileSizeEx(fh, &fileSize);
+    HANDLE mh = fileSize.QuadPart > 0 ? CreateFileMappingW(fh, nullptr, PAGE_READONLY, 0, 0, nullptr) : nullptr;
+    const void *view = mh != nullptr ? MapViewOfFile(mh, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (view == nullptr)
+    {
+      if (mh != nullptr)
+        CloseHandle(mh);
+      CloseHandle(fh);
+      return false;
+    }
+    fileHandle = fh;
+    mappingHandle = mh;
+    bytes = static_cast<const uint8_t *>(view);
+    numBytes = static_cast<size_t>(fileSize.QuadPart);
+#else
+    const int fd = ::open(path.string().c_str(), O_RDONLY);
+    if (fd < 0)
+      return false;
+    struct stat st{};
+    if (fstat(fd, &st) != 0 || st.st_size <= 0)
+    {
+      ::close(fd);
+      return false;
+    }
+    void *view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_SHARED, fd, 0);
+    // the mapping stays valid after closing the descriptor
+    ::close(fd);
+    if (view == MAP_FAILED)
+      return false;
+    bytes = static_cast<const uint8_t *>(view);
+    numBytes = static_cast<size_t>(st.st_size);
+#endif
+    return true;
+  }
+
+  void MappedFile::close()
+  {
+    if (bytes == nullptr)
+      return;
+#if defined(_WIN32)
+    UnmapViewOfFile(bytes);
+    CloseHandle(mappingHandle);
+    CloseHandle(fileHandle);
+    fileHandle = mappingHandle = nullptr;
+#else
+    munmap(const_cast<uint8_t *>(bytes), numBytes);
+#endif
+    bytes = nullptr;
+    numBytes = 0;
+  }
+
+  bool Player::open(const std::filesystem::path &path)
+  {
+    close();
+    if (!file.open(path))
+    {
+      std::cerr << "error mapping trajectory file " << path.string() << "\n";
+      return false;
+    }
+    const Header expected;
+    if (file.size() < sizeof(Header))
+    {
+      std::cerr << "not a trajectory file: " << path.string() << "\n";
+      file.close();
+      return false;
+    }
+    std::memcpy(&header, file.data(), sizeof(Header));
+    if (std::memcmp(header.magic, expected.magic, sizeof(expected.magic)) != 0 || header.version != expected.version ||
+        header.encoding > Encoding::Delta16 || header.keyframeInterval == 0)
+    {
+      std::cerr << "not a trajectory file: " << path.string() << "\n";
+      file.close();
+      return false;
+    }
+    layout = {header.encoding, header.numObjects, header.keyframeInterval};
+    // the per object attributes have to be there, this also bounds numObjects by the file size before allocating.
+    // Compared by division first, a corrupt numObjects could overflow dataOffset().
+    if (header.numObjects > (file.size() - sizeof(Header)) / (2 * sizeof(float)) || file.size() < layout.dataOffset())
+    {
+      std::cerr << "not a trajectory file: " << path.string() << "\n";
+      file.close();
+      return false;
+    }
+    // a recording that was not closed properly has numFrames == 0 but complete frames nevertheless
+    numFrames = layout.numFramesIn(file.size());
+    decodedFrame = -1;
+    decoded.assign(header.numObjects, {});
+    return true;
+  }
+
+  void Player::close()
+  {
+    file.close();
+    numFrames = 0;
+    decoded.clear();
+    decodedFrame = -1;
+  }
+
+  void Player::decodeDeltas(size_t frame)
+  {
+    const int64_t target = static_cast<int64_t>(frame);
+    const int64_t keyframe = target - target % layout.keyframeInterval;
+    if (decodedFrame == target)
+      return;
+    // continue from the last decoded frame if it is in the same group and before, otherwise start at the keyframe
+    int64_t f = decodedFrame;
+    if (f < keyframe || f > target)
+    {
+      const float *values = reinterpret_cast<const float *>(file.data() + layout.frameOffset(static_cast<size_t>(keyframe)) + sizeof(FrameHeader));
+      for (size_t ix = 0; ix < decoded.size(); ++ix, values += 4)
+        decoded[ix] = {values[0], values[1], values[2], values[3]};
+      f = keyframe;
+    }
+    for (++f; f <= target; ++f)
+    {
+      const uint16_t *values = reinterpret_cast<const uint16_t *>(file.data() + layout.frameOffset(static_cast<size_t>(f)) + sizeof(FrameHeader));
+      for (size_t ix = 0; ix < decoded.size(); ++ix, values += 4)
+        for (int c = 0; c < 4; ++c)
+          decoded[ix][c] += halfToFloat(values[c]);
+    }
+    decodedFrame = target;
+  }
+} // namespace trajectory
@@ -0,0 +1,279 @@
+#pragma once
+
+#include "VerletObject.h"
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <atomic>
+#include <bit>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+// Binary trajectory files: a header, mass and radius of every object, then one chunk per recorded frame.
+//   Header                                             64 bytes
+//   numObjects x {float mass, float radius}
+//   frames: {double time, uint32 isKeyframe, uint32 0} then numObjects x {pos.x, pos.y, vel.x, vel.y}
+// Values are little-endian. Frame sizes only depend on the encoding and on whether the frame is a keyframe, hence
+// the offset of any frame is computable and the file can be memory-mapped and scrubbed without an index.
+// Encodings of the per-object values:
+//   Float32: as simulated, 16 bytes per object
+//   Float16: IEEE half floats, 8 bytes per object. ~3 significant digits, |values| < 65504.
+//   Delta16: a Float32 keyframe every keyframeInterval frames, in between half-float differences to the previous frame
+//            as the reader reconstructs it. Quantization errors therefore do not accumulate over a key group.
+namespace trajectory
+{
+  enum class Encoding : uint32_t
+  {
+    Float32,
+    Float16,
+    Delta16,
+  };
+
+  struct Header
+  {
+    char magic[8] = {'G', 'V', 'T', 'R', 'A', 'J', '0', '1'};
+    uint32_t version = 1;
+    Encoding encoding = Encoding::Float32;
+    uint64_t numObjects{};
+    // written when the recording is closed, readers derive it from the file size if the recorder did not finish
+    uint64_t numFrames{};
+    uint32_t keyframeInterval = 1;
+    uint32_t reserved{};
+    // units of the file, see namespace constants: time T0 s, mass M0 kg, length R0 m, G in SI and unitless
+    float T0{};
+    float M0{};
+    float R0{};
+    float GG{};
+    float G0{};
+    float reserved2{};
+  };
+  static_assert(sizeof(Header) == 64 && std::is_trivially_copyable_v<Header>);
+  static_assert(std::endian::native == std::endian::little, "trajectory files are little-endian");
+
+  struct FrameHeader
+  {
+    double time{};
+    uint32_t isKeyframe{};
+    uint32_t reserved{};
+  };
+  static_assert(sizeof(FrameHeader) == 16);
+
+  // IEEE 754 binary16 conversions, round to nearest even
+  inline uint16_t floatToHalf(float value)
+  {
+    const uint32_t bits = std::bit_cast<uint32_t>(value);
+    const uint32_t sign = (bits >> 16) & 0x8000u;
+    const uint32_t absBits = bits & 0x7FFFFFFFu;
+    if (absBits >= 0x7F800000u) // inf or NaN
+      return static_cast<uint16_t>(sign | 0x7C00u | (absBits > 0x7F800000u ? 0x200u : 0u));
+    if (absBits >= 0x477FF000u) // rounds to >= 65520, overflow
+      return static_cast<uint16_t>(sign | 0x7C00u);
+    if (absBits < 0x38800000u) // below the smallest normal half, 2^-14
+    {
+      if (absBits < 0x33000000u) // below half of the smallest subnormal, 2^-25
+        return static_cast<uint16_t>(sign);
+      const uint32_t exponent = absBits >> 23;
+      const uint32_t mantissa = (absBits & 0x7FFFFFu) | 0x800000u;
+      const uint32_t shift = 126 - exponent;
+      uint32_t half = mantissa >> shift;
+      const uint32_t remainder = mantissa & ((1u << shift) - 1);
+      const uint32_t halfway = 1u << (shift - 1);
+      if (remainder > halfway || (remainder == halfway && (half & 1u)))
+        ++half;
+      return static_cast<uint16_t>(sign | half);
+    }
+    uint32_t half = ((absBits - 0x38000000u) >> 13);
+    const uint32_t remainder = absBits & 0x1FFFu;
+    if (remainder > 0x1000u || (remainder == 0x1000u && (half & 1u)))
+      ++half;
+    return static_cast<uint16_t>(sign | half);
+  }
+
+  inline float halfToFloat(uint16_t half)
+  {
+    const uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    const uint32_t exponent = (half >> 10) & 0x1Fu;
+    uint32_t mantissa = half & 0x3FFu;
+    if (exponent == 0x1F)
+      return std::bit_cast<float>(sign | 0x7F800000u | (mantissa << 13));
+    if (exponent != 0)
+      return std::bit_cast<float>(sign | ((exponent + 112) << 23) | (mantissa << 13));
+    if (mantissa == 0)
+      return std::bit_cast<float>(sign);
+    // subnormal half, normalize
+    uint32_t e = 113;
+    while ((mantissa & 0x400u) == 0)
+    {
+      mantissa <<= 1;
+      --e;
+    }
+    return std::bit_cast<float>(sign | (e << 23) | ((mantissa & 0x3FFu) << 13));
+  }
+
+  inline size_t bytesPerObject(Encoding encoding, bool isKeyframe)
+  {
+    return encoding == Encoding::Float32 || (encoding == Encoding::Delta16 && isKeyframe) ? 4 * sizeof(float) : 4 * sizeof(uint16_t);
+  }
+
+  // Layout of frames in a file, see the format above
+  struct Layout
+  {
+    Encoding encoding = Encoding::Float32;
+    uint64_t numObjects{};
+    uint32_t keyframeInterval = 1;
+
+    size_t dataOffset() const { return sizeof(Header) + numObjects * 2 * sizeof(float); }
+    bool isKeyframe(size_t frame) const { return encoding != Encoding::Delta16 || frame % keyframeInterval == 0; }
+    size_t frameBytes(bool isKeyframe) const { return sizeof(FrameHeader) + numObjects * bytesPerObject(encoding, isKeyframe); }
+    size_t frameOffset(size_t frame) const
+    {
+      if (encoding != Encoding::Delta16)
+        return dataOffset() + frame * frameBytes(true);
+      const size_t groupBytes = frameBytes(true) + (keyframeInterval - 1) * frameBytes(false);
+      const size_t inGroup = frame % keyframeInterval;
+      return dataOffset() + frame / keyframeInterval * groupBytes + (inGroup == 0 ? 0 : frameBytes(true) + (inGroup - 1) * frameBytes(false));
+    }
+    // number of complete frames in a file of the given size
+    size_t numFramesIn(size_t fileSize) const;
+  };
+
+  // Records frames of a simulation. Encoding happens on the calling thread, writing on a background thread, so that
+  // record() never waits for the disk. If the writer falls more than maxQueuedFrames behind, frames are dropped
+  // instead. Delta frames always refer to the last queued frame, a dropped frame only makes the next delta longer.
+  class Recorder
+  {
+  public:
+    Recorder() = default;
+    ~Recorder();
+    Recorder(const Recorder &) = delete;
+    Recorder &operator=(const Recorder &) = delete;
+
+    size_t maxQueuedFrames = 64;
+
+    // Writes the header and the static attributes of the objects, starts the writer thread. False if the file can't be created.
+    bool open(const std::filesystem::path &path, const std::vector<VerletObject> &objects, Encoding encoding, uint32_t keyframeInterval = 32);
+    // Queues a frame. Returns false if the recorder is not open, the number of objects changed or the frame was dropped.
+    bool record(const std::vector<VerletObject> &objects, double time);
+    // Writes the queued frames, completes the header and closes the file.
+    void close();
+
+    bool isOpen() const { return file != nullptr; }
+    size_t getNumFrames() const { return numFrames; }
+    size_t getNumDroppedFrames() const { return numDroppedFrames; }
+    size_t getNumQueuedFrames() const;
+    // bytes written to the file so far, by the writer thread
+    size_t getBytesWritten() const { return bytesWritten; }
+
+  private:
+    void writerLoop();
+
+    std::FILE *file = nullptr;
+    Header header;
+    Layout layout;
+    size_t numFrames{};
+    size_t numDroppedFrames{};
+    // values of the last queued frame as the reader will decode them, what delta frames refer to
+    std::vector<glm::vec4> reconstructed;
+
+    std::thread writer;
+    mutable std::mutex mutex;
+    std::condition_variable queueChanged;
+    std::deque<std::vector<uint8_t>> queue;
+    // buffers written by the writer thread, reused for encoding
+    std::vector<std::vector<uint8_t>> freeBuffers;
+    bool stopping = false;
+    std::atomic<size_t> bytesWritten{};
+  };
+
+  // Read-only memory mapping of a whole file
+  class MappedFile
+  {
+  public:
+    MappedFile() = default;
+    ~MappedFile();
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+
+    bool open(const std::filesystem::path &path);
+    void close();
+    const uint8_t *data() const { return bytes; }
+    size_t size() const { return numBytes; }
+
+  private:
+    const uint8_t *bytes = nullptr;
+    size_t numBytes{};
+#if defined(_WIN32)
+    void *fileHandle = nullptr;
+    void *mappingHandle = nullptr;
+#endif
+  };
+
+  // Plays a recorded file back from a memory mapping, frames can be visited in any order.
+  class Player
+  {
+  public:
+    // False if the file can't be mapped or is not a trajectory file.
+    bool open(const std::filesystem::path &path);
+    void close();
+
+    bool isOpen() const { return file.data() != nullptr; }
+    const Header &getHeader() const { return header; }
+    size_t getNumObjects() const { return layout.numObjects; }
+    size_t getNumFrames() const { return numFrames; }
+    float getMass(size_t ix) const { return attributes()[2 * ix]; }
+    float getRadius(size_t ix) const { return attributes()[2 * ix + 1]; }
+    double getTime(size_t frame) const { return frameHeader(frame).time; }
+
+    // Calls fn(ix, pos, vel) for every object at the given frame. Float32 frames are read straight from the mapping,
+    // Delta16 frames are decoded from their keyframe, or incrementally from the last visited frame of the same group.
+    template <typename Fn>
+    void forEachObject(size_t frame, Fn &&fn)
+    {
+      const uint8_t *data = file.data() + layout.frameOffset(frame) + sizeof(FrameHeader);
+      const size_t n = layout.numObjects;
+      switch (layout.encoding)
+      {
+      case Encoding::Float32:
+      {
+        const float *values = reinterpret_cast<const float *>(data);
+        for (size_t ix = 0; ix < n; ++ix, values += 4)
+          fn(ix, glm::vec2{values[0], values[1]}, glm::vec2{values[2], values[3]});
+        break;
+      }
+      case Encoding::Float16:
+      {
+        const uint16_t *values = reinterpret_cast<const uint16_t *>(data);
+        for (size_t ix = 0; ix < n; ++ix, values += 4)
+          fn(ix, glm::vec2{halfToFloat(values[0]), halfToFloat(values[1])}, glm::vec2{halfToFloat(values[2]), halfToFloat(values[3])});
+        break;
+      }
+      case Encoding::Delta16:
+        decodeDeltas(frame);
+        for (size_t ix = 0; ix < n; ++ix)
+          fn(ix, glm::vec2{decoded[ix].x, decoded[ix].y}, glm::vec2{decoded[ix].z, decoded[ix].w});
+        break;
+      }
+    }
+
+  private:
+    const float *attributes() const { return reinterpret_cast<const float *>(file.data() + sizeof(Header)); }
+    const FrameHeader &frameHeader(size_t frame) const { return *reinterpret_cast<const FrameHeader *>(file.data() + layout.frameOffset(frame)); }
+    void decodeDeltas(size_t frame);
+
+    MappedFile file;
+    Header header;
+    Layout layout;
+    size_t numFrames{};
+    std::vector<glm::vec4> decoded;
+    // frame whose values are in decoded, -1 for none
+    int64_t decodedFrame = -1;
+  };
+} // namespace trajectory
@@ -1,107 +1,211 @@
 #pragma once
 
+#include "Fmm.h"
+#include "ForceLaws.h"
+#include "GravityKernel.h"
+#include "Integrators.h"
+#include "Particles.h"
+#include "QuadTree.h"
+#include "VerletObject.h"
+
+#include <MortonOrder.h>
+#include <ThreadPool.h>
+
 #include <glm/vec2.hpp>
 #include <glm/geometric.hpp>
 
+#include <algorithm>
 #include <array>
+#include <cassert>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
 #include <functional>
+#include <limits>
+#include <utility>
+#include <variant>
 #include <vector>
 
-struct VerletObject
-{
-  glm::vec2 pos{};
-  glm::vec2 vel{};
-  float mass = 1.0f;
-  float radius = 0.1f;
-  glm::vec2 acc{};
-};
-
-// TODO: how to deal with stray planents (with high index) -> put them into some maximum value bucket
-// TODO: list of objects that won't be included in cells
-// TODO: use hash_pair_simple and compare perf
+// Uniform grid over VerletObject positions, stored as a flat counting-sorted layout:
+// objIdxs holds the object indices of cell c in [cellStarts[c], cellStarts[c + 1]).
+// All vectors keep their capacity across rebuild() calls, so rebuilding every substep does not allocate.
 class SpatialAccelarator
 {
 public:
+  // cell coordinates relative to the grid's first cell, see minKey
   using PositionIndex = std::pair<int, int>;
 
-  PositionIndex getPosIndex(const VerletObject &obj)
+  // beyond this the grid is centered around the center of mass and stray planets are put into border cells
+  static constexpr int maxCellsPerAxis = 1024;
+
+  float cellSize{0.1f};
+  // world-space cell key of the grid's first cell, i.e. cell (i, j) spans [(minKey + (i, j)) * cellSize, (minKey + (i, j) + 1) * cellSize)
+  PositionIndex minKey{};
+  int numCellsX{};
+  int numCellsY{};
+
+  std::vector<int32_t> cellOfObject;
+  std::vector<int32_t> cellStarts;
+  std::vector<int32_t> objIdxs;
+  // flat indices of non-empty cells
+  std::vector<int32_t> occupiedCells;
+
+  // Mipmap-like pyramid of "average objects", each representing all objects of a cell in their center of mass and
+  // having their total mass (0 for empty cells). Level 0 has the grid's cells, cell (i, j) of level l + 1 merges
+  // cells (2i, 2j) to (2i + 1, 2j + 1) of level l, the last level has a single cell.
+  struct PyramidLevel
+  {
+    int numCellsX{};
+    int numCellsY{};
+    std::vector<VerletObject> cellAverages;
+  };
+  std::vector<PyramidLevel> pyramid;
+  // Cells of level l >= 1 are used for the far field only beyond this many cells of level l, larger is more accurate.
+  // Level 0 cells are used right outside the 3x3 near field.
+  static constexpr int farFieldSeparation = 2;
+
+  SpatialAccelarator() = default;
+
+  SpatialAccelarator(const std::vector<VerletObject> &objects, const float cellSize = 0.1f)
   {
-    const int i = static_cast<int>(std::floor(obj.pos.x / cellSize));
-    const int j = static_cast<int>(std::floor(obj.pos.y / cellSize));
-    return std::make_pair(i, j);
+    rebuild(objects, cellSize);
   }
 
-  // template <class T>
-  // static inline void hash_combine(std::size_t &seed, const T &v)
-  // {
-  //   std::hash<T> hasher;
-  //   seed ^= hasher(v) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
-  // }
-
-  // struct hash_pair
-  // {
-  //   std::size_t operator()(const PositionIndex &p) const
-  //   {
-  //     std::size_t h = 0;
-  //     hash_combine(h, p.first);
-  //     hash_combine(h, p.second);
-  //     return h;
-  //   }
-  // };
-
-  struct hash_pair_simple
+  PositionIndex getPosIndex(const VerletObject &obj) const
   {
-    std::size_t operator()(const std::pair<int, int> &p) const
+    const int i = static_cast<int>(std::floor(obj.pos.x / cellSize)) - minKey.first;
+    const int j = static_cast<int>(std::floor(obj.pos.y / cellSize)) - minKey.second;
+    return std::make_pair(std::clamp(i, 0, numCellsX - 1), std::clamp(j, 0, numCellsY - 1));
+  }
+
+  int32_t cellIndex(const PositionIndex &posIdx) const
+  {
+    return posIdx.second * numCellsX + posIdx.first;
+  }
+
+  PositionIndex posIndexOf(int32_t cellIx) const
+  {
+    return std::make_pair(cellIx % numCellsX, cellIx / numCellsX);
+  }
+
+  void rebuild(const std::vector<VerletObject> &objects, float newCellSize)
+  {
+    cellSize = newCellSize;
+    fitGrid(objects);
+    const size_t numCells = static_cast<size_t>(numCellsX) * numCellsY;
+
+    // count objects per cell, shifted by one so that the prefix sum below turns counts into starts
+    cellOfObject.resize(objects.size());
+    cellStarts.assign(numCells + 1, 0);
+    for (size_t ix = 0; ix < objects.size(); ++ix)
     {
-      return p.first * 10'000 + p.second;
+      cellOfObject[ix] = cellIndex(getPosIndex(objects[ix]));
+      ++cellStarts[cellOfObject[ix] + 1];
+    }
+
+    occupiedCells.clear();
+    for (size_t c = 0; c < numCells; ++c)
+    {
+      if (cellStarts[c + 1] > 0)
+        occupiedCells.push_back(static_cast<int32_t>(c));
+      cellStarts[c + 1] += cellStarts[c];
     }
-  };
 
-  using PositionHashMap = std::unordered_map<PositionIndex, std::vector<std::reference_wrapper<const VerletObject>>, hash_pair_simple>;
-  PositionHashMap cache;
-  std::unordered_map<PositionIndex, VerletObject, hash_pair_simple> cellAverages;
+    // stable scatter, objects keep their relative order within a cell
+    cellCursors.assign(cellStarts.begin(), cellStarts.end() - 1);
+    objIdxs.resize(objects.size());
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+      objIdxs[cellCursors[cellOfObject[ix]]++] = static_cast<int32_t>(ix);
 
-  float cellSize{0.1f};
+    pyramid.resize(1);
+    pyramid[0].numCellsX = numCellsX;
+    pyramid[0].numCellsY = numCellsY;
+    pyramid[0].cellAverages.assign(numCells, VerletObject{{}, {}, 0.0f});
+    for (int32_t c : occupiedCells)
+    {
+      VerletObject avgObj{{}, {}, 0.0f};
+      for (int32_t k = cellStarts[c]; k < cellStarts[c + 1]; ++k)
+      {
+        const auto &o = objects[objIdxs[k]];
+        avgObj.pos += o.pos * o.mass;
+        avgObj.mass += o.mass;
+      }
+      avgObj.pos /= avgObj.mass;
+      pyramid[0].cellAverages[c] = avgObj;
+    }
 
-  using ObjRefIter = std::vector<std::reference_wrapper<const VerletObject>>::const_iterator;
-  using PosIxIter = std::vector<PositionIndex>::iterator;
+    // every level visits each cell of the finer one once, and levels shrink 4x, so this is linear in the number of cells
+    while (pyramid.back().numCellsX > 1 || pyramid.back().numCellsY > 1)
+    {
+      const size_t l = pyramid.size();
+      pyramid.emplace_back();
+      const PyramidLevel &fine = pyramid[l - 1];
+      PyramidLevel &coarse = pyramid[l];
+      coarse.numCellsX = (fine.numCellsX + 1) / 2;
+      coarse.numCellsY = (fine.numCellsY + 1) / 2;
+      coarse.cellAverages.assign(static_cast<size_t>(coarse.numCellsX) * coarse.numCellsY, VerletObject{{}, {}, 0.0f});
+      for (int j = 0; j < fine.numCellsY; ++j)
+        for (int i = 0; i < fine.numCellsX; ++i)
+        {
+          const VerletObject &child = fine.cellAverages[j * fine.numCellsX + i];
+          VerletObject &parent = coarse.cellAverages[(j / 2) * coarse.numCellsX + i / 2];
+          // parent.pos holds the mass weighted sum until the division below
+          parent.pos += child.pos * child.mass;
+          parent.mass += child.mass;
+        }
+      for (auto &avgObj : coarse.cellAverages)
+        if (avgObj.mass > 0)
+          avgObj.pos /= avgObj.mass;
+    }
+
+    this->objects = &objects;
+  }
 
   struct ObjectsInCellsIterator
   {
-    ObjectsInCellsIterator(const SpatialAccelarator &acc, const PosIxIter &posIxIter, const ObjRefIter &objRefIter, const PosIxIter &lastPosIxIter)
-        : acc{acc}, posIxIter{posIxIter}, objRefIter{objRefIter}, lastPosIxIter{lastPosIxIter} {}
+    ObjectsInCellsIterator(const SpatialAccelarator &acc, const int32_t *cellIt, const int32_t *cellsEnd)
+        : acc{acc}, cellIt{cellIt}, cellsEnd{cellsEnd}
+    {
+      skipEmptyCells();
+    }
 
     // or `friend bool operator!=(const Iter& left, const Iter& right)
-    bool operator!=(const ObjectsInCellsIterator &other)
+    bool operator!=(const ObjectsInCellsIterator &other) const
     {
-      return posIxIter != other.posIxIter || objRefIter != other.objRefIter;
+      return cellIt != other.cellIt || objPos != other.objPos;
     }
 
-    // For each cell go over every VerletObject ref.
-    // When reaching .end() of cell, increment cell iterator, and start from its begin()
+    // For each cell go over the object indices in its [start, end) span of objIdxs.
+    // When reaching the end of a cell, continue from the start of the next non-empty one.
     ObjectsInCellsIterator &operator++()
     {
-      const auto &currentCell = acc.cache.at(*posIxIter);
-      ++objRefIter;
-      if (objRefIter == currentCell.end() && posIxIter != lastPosIxIter)
+      ++objPos;
+      if (objPos == acc.cellStarts[*cellIt + 1])
       {
-        ++posIxIter;
-        // don't want to dereference posIxIter for cells.end() therefor we lastPosIxIter above
-        objRefIter = acc.cache.at(*posIxIter).begin();
+        ++cellIt;
+        skipEmptyCells();
       }
       return *this;
     }
 
     const VerletObject &operator*() const
     {
-      return objRefIter->get();
+      return (*acc.objects)[acc.objIdxs[objPos]];
     }
 
   private:
+    // end iterator is (cellsEnd, 0)
+    void skipEmptyCells()
+    {
+      while (cellIt != cellsEnd && acc.cellStarts[*cellIt] == acc.cellStarts[*cellIt + 1])
+        ++cellIt;
+      objPos = cellIt != cellsEnd ? acc.cellStarts[*cellIt] : 0;
+    }
+
     const SpatialAccelarator &acc;
-    PosIxIter posIxIter;
-    ObjRefIter objRefIter;
-    const PosIxIter &lastPosIxIter;
+    const int32_t *cellIt;
+    const int32_t *cellsEnd;
+    int32_t objPos{};
   };
 
   // Range of all VerletObjects in the cell and its neighbors with given PositionIndex
@@ -109,207 +213,931 @@ public:
   {
     NeighboringObjectsRange(const SpatialAccelarator &acc, const PositionIndex &posIdx) : acc{acc}
     {
-      for (const auto &[posIdx2, _] : acc.cache)
-        if (std::abs(posIdx.first - posIdx2.first) <= 1 && std::abs(posIdx.second - posIdx2.second) <= 1)
-          neighborCellIdxs.push_back(posIdx2);
-        else
-          distantCellIdxs.push_back(posIdx2);
-
-      assert(neighborCellIdxs.size() > 0);
-      posIxBeginIter = neighborCellIdxs.begin();
-      objBeginIter = acc.cache.at(*posIxBeginIter).begin();
-
-      posIxLastIter = neighborCellIdxs.end() - 1;
-      objEndIter = acc.cache.at(*posIxLastIter).end();
+      // direct lookup of the 3x3 block, empty cells are skipped by the iterator
+      for (int j = std::max(posIdx.second - 1, 0); j <= std::min(posIdx.second + 1, acc.numCellsY - 1); ++j)
+        for (int i = std::max(posIdx.first - 1, 0); i <= std::min(posIdx.first + 1, acc.numCellsX - 1); ++i)
+          neighborCellIdxs[numNeighborCells++] = acc.cellIndex({i, j});
     }
 
-    // NeighboringObjectsRange(SpatialAccelarator &acc, const VerletObject &obj) : NeighboringObjectsRange(acc, acc.getPosIndex(obj)) {}
-
     ObjectsInCellsIterator begin() const
     {
-      return ObjectsInCellsIterator(acc, posIxBeginIter, objBeginIter, posIxLastIter);
+      return ObjectsInCellsIterator(acc, neighborCellIdxs.data(), neighborCellIdxs.data() + numNeighborCells);
     }
 
     ObjectsInCellsIterator end() const
     {
-      return ObjectsInCellsIterator(acc, posIxLastIter, objEndIter, posIxLastIter);
+      const int32_t *cellsEnd = neighborCellIdxs.data() + numNeighborCells;
+      return ObjectsInCellsIterator(acc, cellsEnd, cellsEnd);
     }
 
-    std::vector<PositionIndex> distantCellIdxs;
-
   private:
     const SpatialAccelarator &acc;
-    std::vector<PositionIndex> neighborCellIdxs;
-    PosIxIter posIxBeginIter;
-    PosIxIter posIxLastIter; // not end!
-    ObjRefIter objBeginIter;
-    ObjRefIter objEndIter;
+    std::array<int32_t, 9> neighborCellIdxs{};
+    int numNeighborCells{};
   };
 
-  SpatialAccelarator(const std::vector<VerletObject> &objects, const float cellSize = 0.1f)
-      : cellSize(cellSize)
+  NeighboringObjectsRange neighborsOf(const PositionIndex &posIdx) const
   {
-    for (const auto &obj : objects)
-      cache[getPosIndex(obj)].push_back(obj);
+    return NeighboringObjectsRange(*this, posIdx);
+  }
 
-    for (const auto &[pIx, vec] : cache)
+  NeighboringObjectsRange neighborsOf(const VerletObject &obj) const
+  {
+    return NeighboringObjectsRange(*this, getPosIndex(obj));
+  }
+
+  // Calls fn(const VerletObject &) with the "average objects" standing for everything outside the 3x3 neighborhood of the
+  // given cell, like the interaction lists of a tree code: with a_l the ancestor of the cell at level l, level l
+  // contributes the cells around a_(l + 1) (children of the cells within farFieldSeparation of it) that are not near a_l,
+  // the top level all cells not near a_top. Each cell of the grid is covered exactly once and farther regions by coarser
+  // cells, hence a query visits O(farFieldSeparation^2 log(numCells)) cells.
+  template <typename Fn>
+  void forEachDistantAggregate(const PositionIndex &posIdx, Fn &&fn) const
+  {
+    const int numLevels = static_cast<int>(pyramid.size());
+    for (int l = 0; l < numLevels; ++l)
     {
-      // "average object" representing all objects in a center of mass and has total mass
-      auto &avgObj = cellAverages[pIx];
-      for (const auto &obj : vec)
+      const PyramidLevel &level = pyramid[l];
+      const int ai = posIdx.first >> l;
+      const int aj = posIdx.second >> l;
+      const int near = l == 0 ? 1 : farFieldSeparation;
+      int i0 = 0, j0 = 0, i1 = level.numCellsX - 1, j1 = level.numCellsY - 1;
+      if (l + 1 < numLevels)
       {
-        const auto &o = obj.get();
-        avgObj.pos += o.pos * o.mass;
-        avgObj.mass += o.mass;
+        i0 = std::max(i0, 2 * ((ai >> 1) - farFieldSeparation));
+        j0 = std::max(j0, 2 * ((aj >> 1) - farFieldSeparation));
+        i1 = std::min(i1, 2 * ((ai >> 1) + farFieldSeparation) + 1);
+        j1 = std::min(j1, 2 * ((aj >> 1) + farFieldSeparation) + 1);
       }
-      avgObj.pos /= avgObj.mass;
+      for (int j = j0; j <= j1; ++j)
+        for (int i = i0; i <= i1; ++i)
+        {
+          if (std::abs(i - ai) <= near && std::abs(j - aj) <= near)
+            continue;
+          const VerletObject &avgObj = level.cellAverages[j * level.numCellsX + i];
+          if (avgObj.mass > 0)
+            fn(avgObj);
+        }
     }
   }
 
-  NeighboringObjectsRange neighborsOf(const PositionIndex &posIdx) const
+  void debugPrint() const
   {
-    return NeighboringObjectsRange(*this, posIdx);
+    for (int32_t c : occupiedCells)
+    {
+      const auto [i, j] = posIndexOf(c);
+      printf("[%d, %d]: %d\n", minKey.first + i, minKey.second + j, cellStarts[c + 1] - cellStarts[c]);
+    }
+    printf("******************\n\n");
   }
 
-  NeighboringObjectsRange neighborsOf(const VerletObject &obj)
+private:
+  // Picks minKey and grid dimensions covering all objects, at most maxCellsPerAxis in each direction.
+  void fitGrid(const std::vector<VerletObject> &objects)
   {
-    return NeighboringObjectsRange(*this, getPosIndex(obj));
-  }
+    if (objects.empty())
+    {
+      minKey = {};
+      numCellsX = numCellsY = 1;
+      return;
+    }
 
-  void debugPrint()
-  {
-    for (auto &[key, v] : cache)
+    glm::vec2 minPos{std::numeric_limits<float>::max()};
+    glm::vec2 maxPos{std::numeric_limits<float>::lowest()};
+    glm::vec2 weightedPos{};
+    float mass{};
+    for (const auto &obj : objects)
     {
-      printf("[%d, %d]: %zu\n", key.first, key.second, v.size());
+      minPos = glm::min(minPos, obj.pos);
+      maxPos = glm::max(maxPos, obj.pos);
+      weightedPos += obj.pos * obj.mass;
+      mass += obj.mass;
     }
-    printf("******************\n\n");
+    const glm::vec2 com = mass > 0 ? weightedPos / mass : (minPos + maxPos) * 0.5f;
+
+    const auto fitAxis = [&](float minCoord, float maxCoord, float comCoord, int &minK, int &numCells)
+    {
+      const double lo = std::floor(minCoord / cellSize);
+      const double hi = std::floor(maxCoord / cellSize);
+      if (hi - lo + 1 <= maxCellsPerAxis)
+      {
+        minK = static_cast<int>(lo);
+        numCells = static_cast<int>(hi - lo) + 1;
+      }
+      else
+      {
+        minK = static_cast<int>(std::floor(comCoord / cellSize)) - maxCellsPerAxis / 2;
+        numCells = maxCellsPerAxis;
+      }
+    };
+    fitAxis(minPos.x, maxPos.x, com.x, minKey.first, numCellsX);
+    fitAxis(minPos.y, maxPos.y, com.y, minKey.second, numCellsY);
   }
+
+  const std::vector<VerletObject> *objects{};
+  std::vector<int32_t> cellCursors;
 };
 
-using InterForce = std::function<glm::vec2(const VerletObject &obj1, const VerletObject &obj2)>;
+// only used for plotting potentials, solvers evaluate ForceLaw policies
 using InterPotential = std::function<float(const VerletObject &obj1, const VerletObject &obj2)>;
 
+// Potential energy of a pair of objects under a force law, outside of hot loops.
+inline float pairPotential(const ForceLaw &forceLaw, const VerletObject &obj1, const VerletObject &obj2)
+{
+  const glm::vec2 r = obj1.pos - obj2.pos;
+  const auto evaluate = [&](const auto &law)
+  { return obj1.mass * obj2.mass * law.evaluate(glm::dot(r, r)).potential; };
+  return std::visit(evaluate, forceLaw);
+}
+
+// Stable in-place compaction after Solver::mergeOverlapping(): item old moves to remap[old] if it survived.
+// Survivors get consecutive new indices in their old order, a merged item maps to the earlier index of its survivor,
+// hence survivors are exactly the items with remap[old] == number of survivors before them.
+template <typename T>
+void compactByRemap(std::vector<T> &items, const std::vector<uint32_t> &remap)
+{
+  size_t numKept = 0;
+  for (size_t old = 0; old < remap.size(); ++old)
+    if (remap[old] == numKept)
+      items[numKept++] = items[old];
+  items.resize(numKept);
+}
+
 class Solver
 {
 public:
   std::vector<VerletObject> &objects;
-  InterForce interObjectForce;
-  InterPotential interObjectPotential;
-  float potential{};
-  float kinetic{};
+  // Can be changed between updates. Each update visits it once and runs pair loops instantiated for that law.
+  ForceLaw forceLaw;
+  // energies at the end of the last update, summed in double: the self-pair terms of heavy objects are orders of magnitude
+  // larger than the changes of the total, float would round those away
+  double potential{};
+  double kinetic{};
+  // rebuilt every substep by updateOptimized() and updateBarnesHut(), kept as members to reuse their storage
+  SpatialAccelarator spatialAccelarator;
+  QuadTree quadTree;
+  Fmm fmm;
+  // structure-of-arrays copy of objects used by updateSoA()
+  ParticleStore particles;
+  // double precision state of updateMixedPrecision()
+  MixedParticleStore mixedParticles;
+  // Runs the per-object phases (drift, kicks, forces) in parallel when set, serially when nullptr.
+  // Work is cut into chunks of chunkSize objects in both cases and energies are summed per chunk then in chunk order,
+  // hence results are bit-identical for any number of threads.
+  ws::ThreadPool *threadPool = nullptr;
+  static constexpr size_t chunkSize = 256;
+  // targets per chunk of updateMixedPrecision(). A run this long of the Z-order spans about a quadtree cell holding as
+  // many objects, whose center is the chunk's local origin. Sources are converted to it once per chunk, which costs
+  // little next to the chunk's pairs.
+  static constexpr size_t mixedChunkSize = 32;
+  // used by all update methods except updateBlockSteps(), which is kick-drift-kick by construction
+  integrator::Scheme integrationScheme = integrator::velocityVerlet;
+  // number of per-object force evaluations in the last update
+  size_t numForceEvaluations{};
+  // finest step level in use after the last updateBlockSteps()
+  int finestStepLevel{};
 
 public:
-  Solver(std::vector<VerletObject> &objects, InterForce interObjectForce, InterPotential interObjectPotential = nullptr)
-      : objects(objects), interObjectForce(interObjectForce), interObjectPotential(interObjectPotential)
+  // computeInitialAccelerations = false keeps the acc objects already carry, e.g. when they come from another solver
+  Solver(std::vector<VerletObject> &objects, ForceLaw forceLaw, bool computeInitialAccelerations = true)
+      : objects(objects), forceLaw(forceLaw)
   {
+    if (!computeInitialAccelerations)
+      return;
     // calculate initial acc
-    for (size_t i = 0; i < objects.size(); ++i)
+    const auto accumulateInitialAccelerations = [&](const auto &law)
+    { symmetricAccelerations<false>(law); };
+    std::visit(accumulateInitialAccelerations, forceLaw);
+  }
+
+  void updateOptimized(float period, int numIter, float cellSize)
+  {
+    const auto run = [&](const auto &law)
+    {
+      const auto computeAccelerations = [&](bool computePotential)
+      {
+        spatialAccelarator.rebuild(objects, cellSize);
+        return computePotential ? gridAccelerations<true>(law) : gridAccelerations<false>(law);
+      };
+      integrate(period, numIter, computeAccelerations);
+    };
+    std::visit(run, forceLaw);
+  }
+
+  // Barnes-Hut: O(N log N) per substep. theta = 0 degenerates into the exact all-pairs sum.
+  // Potential keeps the same all-ordered-pairs (including self) convention as update() so that energies are comparable.
+  void updateBarnesHut(float period, int numIter, float theta)
+  {
+    const auto run = [&](const auto &law)
+    {
+      const auto computeAccelerations = [&](bool computePotential)
+      {
+        quadTree.build(objects);
+        return computePotential ? barnesHutAccelerations<true>(law, theta) : barnesHutAccelerations<false>(law, theta);
+      };
+      integrate(period, numIter, computeAccelerations);
+    };
+    std::visit(run, forceLaw);
+  }
+
+  // Fast multipole method with expansions of the given order, see Fmm.h. O(N) per substep.
+  // Far field only for the gravitational laws, Lennard-Jones is treated as short ranged and only interacts with neighbor leaves.
+  void updateFmm(float period, int numIter, int order)
+  {
+    const auto run = [&](const auto &law)
+    {
+      const auto computeAccelerations = [&](bool computePotential)
+      {
+        return computePotential ? fmmAccelerations<true>(law, order) : fmmAccelerations<false>(law, order);
+      };
+      integrate(period, numIter, computeAccelerations);
+    };
+    std::visit(run, forceLaw);
+  }
+
+  // Exact forces with individual power-of-two time steps (block time steps, e.g. Makino 1991, Springel 2005 GADGET-2).
+  // Each base step period / numIter is split into 2^maxLevel ticks and an object of stepLevel k takes steps of
+  // 2^(maxLevel - k) ticks. Every tick all objects drift, which predicts positions of the inactive ones, but only the
+  // objects whose step ends get their forces computed and are kicked (kick-drift-kick). All objects are synchronized at
+  // the end of a base step, so energies are exact there.
+  // Levels come from the Aarseth-like criterion dt = eta |a| / |da/dt| with the jerk estimated from the accelerations at
+  // both ends of the last step. Objects may switch to a finer level at the end of any step and to the next coarser one
+  // when the coarser step is aligned. Unassigned objects start at the finest level.
+  void updateBlockSteps(float period, int numIter, int maxLevel, float eta)
+  {
+    period /= numIter;
+    const uint32_t numTicks = 1u << maxLevel;
+    const float tick = period / static_cast<float>(numTicks);
+    const auto stepOf = [&](int level)
+    { return period / static_cast<float>(1u << level); };
+    for (auto &obj : objects)
+      if (obj.stepLevel < 0 || obj.stepLevel > maxLevel)
+        obj.stepLevel = maxLevel;
+
+    numForceEvaluations = 0;
+    potential = 0.0f;
+    kinetic = 0.0f;
+    const auto run = [&](const auto &law)
     {
-      for (size_t j = i + 1; j < objects.size(); ++j)
+      for (int n = 0; n < numIter; ++n)
       {
-        VerletObject &o1 = objects[i];
-        VerletObject &o2 = objects[j];
-        const glm::vec2 f = interObjectForce(o1, o2);
-        o1.acc -= f / o1.mass;
-        o2.acc += f / o2.mass;
+        // v[t + h / 2] = v[t] + 1/2 a[t] h, everyone starts a step at the beginning of a base step
+        ws::forEachChunk(threadPool, objects.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                         {
+          for (size_t i = begin; i < end; ++i)
+            objects[i].vel += 0.5f * objects[i].acc * stepOf(objects[i].stepLevel); });
+
+        for (uint32_t ticksDone = 1; ticksDone <= numTicks; ++ticksDone)
+        {
+          // p[t + tick] = p[t] + v[t + h / 2] tick, for all objects
+          ws::forEachChunk(threadPool, objects.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                           {
+            for (size_t i = begin; i < end; ++i)
+              objects[i].pos += objects[i].vel * tick; });
+
+          const auto isActive = [&](const VerletObject &obj)
+          { return ticksDone % (numTicks >> obj.stepLevel) == 0; };
+          activeObjects.clear();
+          for (uint32_t i = 0; i < objects.size(); ++i)
+            if (isActive(objects[i]))
+              activeObjects.push_back(i);
+          numForceEvaluations += activeObjects.size();
+
+          const bool isSynchronized = ticksDone == numTicks;
+          const bool computePotential = isSynchronized && n == numIter - 1;
+          const auto kickActive = [&](size_t begin, size_t end)
+          {
+            double chunkPotential{};
+            for (size_t k = begin; k < end; ++k)
+            {
+              VerletObject &obj1 = objects[activeObjects[k]];
+              VerletObject probe = obj1;
+              probe.acc = {};
+              float pot{};
+              // the old acc is still needed for the jerk estimate, the new one is kept aside until the kicks
+              for (const auto &obj2 : objects)
+              {
+                if (computePotential)
+                  interact<true>(law, probe, obj2, pot);
+                else
+                  interact<false>(law, probe, obj2, pot);
+              }
+              chunkPotential += pot;
+              newAccs[k] = probe.acc;
+            }
+            return chunkPotential;
+          };
+          newAccs.resize(activeObjects.size());
+          const double pot = sumOverChunks(activeObjects.size(), kickActive);
+
+          ws::forEachChunk(threadPool, activeObjects.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                           {
+            for (size_t k = begin; k < end; ++k)
+            {
+              VerletObject &obj = objects[activeObjects[k]];
+              const float h = stepOf(obj.stepLevel);
+              // v[t + h] = v[t + h / 2] + 1/2 a[t + h] h
+              obj.vel += 0.5f * newAccs[k] * h;
+
+              const float jerk = glm::length(newAccs[k] - obj.acc) / h;
+              const float accLength = glm::length(newAccs[k]);
+              obj.acc = newAccs[k];
+              int level = maxLevel;
+              if (jerk == 0.0f)
+                level = 0;
+              else if (accLength > 0.0f)
+                level = static_cast<int>(std::ceil(std::log2(period * jerk / (eta * accLength))));
+              level = std::clamp(level, 0, maxLevel);
+              // coarsen by one level at a time and only where the coarser step starts
+              if (level < obj.stepLevel)
+                level = ticksDone % (numTicks >> (obj.stepLevel - 1)) == 0 ? obj.stepLevel - 1 : obj.stepLevel;
+              obj.stepLevel = level;
+
+              // the next step starts right away, except at the end of the base step where all objects start together
+              if (!isSynchronized)
+                obj.vel += 0.5f * obj.acc * stepOf(obj.stepLevel);
+            } });
+
+          if (computePotential)
+            potential = pot;
+        }
       }
+    };
+    std::visit(run, forceLaw);
+
+    finestStepLevel = 0;
+    double kin{};
+    for (const auto &obj : objects)
+    {
+      finestStepLevel = std::max(finestStepLevel, obj.stepLevel);
+      kin += 0.5f * obj.mass * glm::dot(obj.vel, obj.vel);
     }
+    kinetic = kin;
   }
 
-  void updateOptimized(float period, int numIter, float cellSize, SpatialAccelarator *&sa)
+  // Exact all-pairs forces on the SoA particle store. Plummer-form laws use the SIMD kernel of GravityKernel.h.
+  // Objects are converted to and from the SoA only once per call, i.e. at the render boundary.
+  void updateSoA(float period, int numIter)
   {
+    particles.load(objects);
+    float *x = particles.x.data();
+    float *y = particles.y.data();
+    float *vx = particles.vx.data();
+    float *vy = particles.vy.data();
+    float *ax = particles.ax.data();
+    float *ay = particles.ay.data();
+    const float *mass = particles.mass.data();
+
+    // same splitting scheme steps as integrate(), written over plain arrays so that the compiler can vectorize them
     period /= numIter;
     potential = 0.0f;
     kinetic = 0.0f;
+    numForceEvaluations = 0;
+    const integrator::Scheme &scheme = integrationScheme;
     for (int n = 0; n < numIter; ++n)
     {
-      // p[t + dt] = p[t] + v[t] dt + 1/2 a dt^2
-      for (VerletObject &obj : objects)
-        obj.pos += obj.vel * period + obj.acc * (period * period * 0.5f);
-
-      // v[t + dt / 2] = v[t] + 1/2 a[t] dt
-      for (VerletObject &obj : objects)
+      const bool isLastIter = n == numIter - 1;
+      for (int k = 0; k < scheme.numStages; ++k)
       {
-        obj.vel += 0.5f * obj.acc * period;
-        // after using acc reset it for the next computation/accumulation
-        obj.acc = {};
+        const bool isLast = isLastIter && k == scheme.numStages - 1;
+        const bool needsAccelerations = scheme.kicks[k] != 0.0f || isLast;
+        const float kick = k == 0 ? scheme.firstKick * period : 0.0f;
+        const float drift = scheme.drifts[k] * period;
+        ws::forEachChunk(threadPool, particles.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                         {
+          for (size_t i = begin; i < end; ++i)
+          {
+            vx[i] += kick * ax[i];
+            vy[i] += kick * ay[i];
+            x[i] += drift * vx[i];
+            y[i] += drift * vy[i];
+            if (needsAccelerations)
+            {
+              ax[i] = 0.0f;
+              ay[i] = 0.0f;
+            }
+          } });
+        if (!needsAccelerations)
+          continue;
+
+        // positions of all particles have to be updated before any force is computed, hence a separate pass
+        const auto accumulate = [&](const auto &law)
+        {
+          return sumOverChunks(particles.size(), [&](size_t begin, size_t end)
+                               { return gravity::accumulateAccelerations(particles, law, begin, end); });
+        };
+        const double pot = std::visit(accumulate, forceLaw);
+        numForceEvaluations += particles.size();
+
+        const float stageKick = scheme.kicks[k] * period;
+        const double kin = sumOverChunks(particles.size(), [&](size_t begin, size_t end)
+                                         {
+          double chunkKinetic{};
+          for (size_t i = begin; i < end; ++i)
+          {
+            vx[i] += stageKick * ax[i];
+            vy[i] += stageKick * ay[i];
+            chunkKinetic += 0.5f * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i]);
+          }
+          return chunkKinetic; });
+
+        if (isLast)
+        {
+          potential = pot;
+          kinetic = kin;
+        }
       }
+    }
+    particles.store(objects);
+  }
 
-      sa = new SpatialAccelarator{objects, cellSize};
+  // Exact all-pairs forces like updateSoA(), but positions, velocities, accelerations and energies are kept in double.
+  // Only the pair kernel runs in float (SIMD), on coordinates relative to the targets' block, see
+  // gravity::accumulateAccelerationsMixed(). Costs a conversion per source and block over updateSoA(), not a double kernel.
+  // Targets are taken in chunks of mixedChunkSize of a Z-order sort of their positions, so that a chunk is compact
+  // whatever the order of the objects and its local origin is close to all of them. The objects' order stays as is.
+  void updateMixedPrecision(float period, int numIter)
+  {
+    MixedParticleStore &ps = mixedParticles;
+    ps.load(objects);
+    // objects move little during an update, its start's order keeps the chunks compact
+    mixedTargetOrder.compute(ps.size(), [&ps](size_t ix)
+                             { return glm::vec2{static_cast<float>(ps.x[ix]), static_cast<float>(ps.y[ix])}; });
+    const uint32_t *targets = mixedTargetOrder.order.data();
+    double *x = ps.x.data();
+    double *y = ps.y.data();
+    double *vx = ps.vx.data();
+    double *vy = ps.vy.data();
+    double *ax = ps.ax.data();
+    double *ay = ps.ay.data();
+    const float *mass = ps.mass.data();
 
-      // a[t + dt] = 1/m f(p[t + dt])
-      for (auto &obj1 : objects)
+    const double h = static_cast<double>(period) / numIter;
+    potential = 0.0;
+    kinetic = 0.0;
+    numForceEvaluations = 0;
+    const integrator::Scheme &scheme = integrationScheme;
+    for (int n = 0; n < numIter; ++n)
+    {
+      const bool isLastIter = n == numIter - 1;
+      for (int k = 0; k < scheme.numStages; ++k)
       {
-        const auto &rng = sa->neighborsOf(obj1);
-        for (auto &obj2 : rng)
+        const bool isLast = isLastIter && k == scheme.numStages - 1;
+        const bool needsAccelerations = scheme.kicks[k] != 0.0f || isLast;
+        const double kick = k == 0 ? scheme.firstKick * h : 0.0;
+        const double drift = scheme.drifts[k] * h;
+        ws::forEachChunk(threadPool, ps.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                         {
+          for (size_t i = begin; i < end; ++i)
+          {
+            vx[i] += kick * ax[i];
+            vy[i] += kick * ay[i];
+            x[i] += drift * vx[i];
+            y[i] += drift * vy[i];
+            if (needsAccelerations)
+            {
+              ax[i] = 0.0;
+              ay[i] = 0.0;
+            }
+          } });
+        if (!needsAccelerations)
+          continue;
+
+        const auto accumulate = [&](const auto &law)
         {
-          obj1.acc -= interObjectForce(obj1, obj2) / obj1.mass;
-          if (interObjectPotential && n == numIter - 1)
-            potential += interObjectPotential(obj1, obj2);
-        }
+          return sumOverChunks(ps.size(), [&](size_t begin, size_t end)
+                               { return gravity::accumulateAccelerationsMixed(ps, law, targets + begin, end - begin); }, mixedChunkSize);
+        };
+        const double pot = std::visit(accumulate, forceLaw);
+        numForceEvaluations += ps.size();
+
+        const double stageKick = scheme.kicks[k] * h;
+        const double kin = sumOverChunks(ps.size(), [&](size_t begin, size_t end)
+                                         {
+          double chunkKinetic{};
+          for (size_t i = begin; i < end; ++i)
+          {
+            vx[i] += stageKick * ax[i];
+            vy[i] += stageKick * ay[i];
+            chunkKinetic += 0.5 * mass[i] * (vx[i] * vx[i] + vy[i] * vy[i]);
+          }
+          return chunkKinetic; });
 
-        for (auto &posIx : rng.distantCellIdxs)
+        if (isLast)
         {
-          auto &obj2 = sa->cellAverages[posIx];
-          obj1.acc -= interObjectForce(obj1, obj2) / obj1.mass;
-          if (interObjectPotential && n == numIter - 1)
-            potential += interObjectPotential(obj1, obj2);
+          potential = pot;
+          kinetic = kin;
         }
       }
+    }
+    ps.store(objects);
+  }
+
+  // Inelastic merging: every group of overlapping objects (|p_i - p_j| < r_i + r_j, transitively) becomes one object at
+  // their center of mass with their total mass, momentum and volume (r^3 summed, i.e. spheres of equal density).
+  // Overlaps are found on spatialAccelarator with cells of twice the largest radius, so that overlapping objects are
+  // always in neighboring cells. The merged object takes the place of the group's lowest index and the array is
+  // compacted in place keeping the order of the survivors. remap[old index] receives the new index of every object, see
+  // compactByRemap() for applying it to arrays parallel to objects. Returns the number of objects removed.
+  size_t mergeOverlapping(std::vector<uint32_t> &remap)
+  {
+    const size_t n = objects.size();
+    remap.resize(n);
+    float maxRadius{};
+    for (const auto &obj : objects)
+      maxRadius = std::max(maxRadius, obj.radius);
+    if (n < 2 || maxRadius <= 0.0f)
+    {
+      for (size_t ix = 0; ix < n; ++ix)
+        remap[ix] = static_cast<uint32_t>(ix);
+      return 0;
+    }
+    spatialAccelarator.rebuild(objects, 2.0f * maxRadius);
 
-      // v[t + dt] = v[t + dt / 2] + 1/2 a[t + dt] dt
-      for (VerletObject &obj : objects)
+    // overlapping pairs (i < j) found per chunk, merged in chunk order below so that the result is deterministic
+    const size_t numChunks = (n + chunkSize - 1) / chunkSize;
+    overlapPairs.resize(numChunks);
+    ws::forEachChunk(threadPool, n, chunkSize, [&](size_t chunkIx, size_t begin, size_t end)
+                     {
+      std::vector<std::pair<uint32_t, uint32_t>> &pairs = overlapPairs[chunkIx];
+      pairs.clear();
+      for (size_t i = begin; i < end; ++i)
+      {
+        const VerletObject &obj1 = objects[i];
+        const auto posIdx = spatialAccelarator.getPosIndex(obj1);
+        for (int nj = std::max(posIdx.second - 1, 0); nj <= std::min(posIdx.second + 1, spatialAccelarator.numCellsY - 1); ++nj)
+          for (int ni = std::max(posIdx.first - 1, 0); ni <= std::min(posIdx.first + 1, spatialAccelarator.numCellsX - 1); ++ni)
+          {
+            const int32_t c = spatialAccelarator.cellIndex({ni, nj});
+            for (int32_t k = spatialAccelarator.cellStarts[c]; k < spatialAccelarator.cellStarts[c + 1]; ++k)
+            {
+              const uint32_t j = static_cast<uint32_t>(spatialAccelarator.objIdxs[k]);
+              if (j <= i)
+                continue;
+              const VerletObject &obj2 = objects[j];
+              const glm::vec2 r = obj1.pos - obj2.pos;
+              const float reach = obj1.radius + obj2.radius;
+              if (glm::dot(r, r) < reach * reach)
+                pairs.emplace_back(static_cast<uint32_t>(i), j);
+            }
+          }
+      } });
+
+    // union-find whose roots are the lowest index of their group
+    mergeParents.resize(n);
+    for (size_t ix = 0; ix < n; ++ix)
+      mergeParents[ix] = static_cast<uint32_t>(ix);
+    const auto findRoot = [&](uint32_t ix)
+    {
+      while (mergeParents[ix] != ix)
       {
-        obj.vel += 0.5f * obj.acc * period;
-        if (n == numIter - 1)
-          kinetic += 0.5f * obj.mass * glm::dot(obj.vel, obj.vel);
+        mergeParents[ix] = mergeParents[mergeParents[ix]];
+        ix = mergeParents[ix];
       }
+      return ix;
+    };
+    bool hasOverlaps = false;
+    for (const auto &pairs : overlapPairs)
+      for (const auto &[i, j] : pairs)
+      {
+        const uint32_t ri = findRoot(i);
+        const uint32_t rj = findRoot(j);
+        if (ri != rj)
+          mergeParents[std::max(ri, rj)] = std::min(ri, rj);
+        hasOverlaps = true;
+      }
+    if (!hasOverlaps)
+    {
+      for (size_t ix = 0; ix < n; ++ix)
+        remap[ix] = static_cast<uint32_t>(ix);
+      return 0;
     }
+
+    // mass weighted sums in double per root, then the survivors are moved down in index order
+    mergeGroups.assign(n, MergeGroup{});
+    for (size_t ix = 0; ix < n; ++ix)
+    {
+      const VerletObject &obj = objects[ix];
+      MergeGroup &g = mergeGroups[findRoot(static_cast<uint32_t>(ix))];
+      const double m = obj.mass;
+      g.mass += m;
+      g.pos += m * glm::dvec2{obj.pos.x, obj.pos.y};
+      g.vel += m * glm::dvec2{obj.vel.x, obj.vel.y};
+      g.acc += m * glm::dvec2{obj.acc.x, obj.acc.y};
+      g.volume += static_cast<double>(obj.radius) * obj.radius * obj.radius;
+      // the finest level of the group, updateBlockSteps() coarsens it again if possible
+      g.stepLevel = std::max(g.stepLevel, obj.stepLevel);
+    }
+    uint32_t numKept = 0;
+    for (size_t ix = 0; ix < n; ++ix)
+    {
+      const uint32_t root = findRoot(static_cast<uint32_t>(ix));
+      if (root != ix)
+      {
+        remap[ix] = remap[root];
+        continue;
+      }
+      VerletObject obj = objects[ix];
+      const MergeGroup &g = mergeGroups[ix];
+      if (g.mass > 0.0)
+      {
+        obj.pos = glm::vec2{g.pos / g.mass};
+        obj.vel = glm::vec2{g.vel / g.mass};
+        obj.acc = glm::vec2{g.acc / g.mass};
+      }
+      obj.mass = static_cast<float>(g.mass);
+      obj.radius = static_cast<float>(std::cbrt(g.volume));
+      obj.stepLevel = g.stepLevel;
+      remap[ix] = numKept;
+      objects[numKept++] = obj;
+    }
+    const size_t numRemoved = n - numKept;
+    objects.resize(numKept);
+    return numRemoved;
+  }
+
+  // Sorts objects along a Z-order curve, so that objects close in space are close in memory. Initial conditions and
+  // merging leave them scattered, which makes the passes over neighbors (grid cells, tree leaves) miss the cache.
+  // Meant to be called every some updates, objects drift apart slowly. The double state of updateMixedPrecision()
+  // follows the objects. Returns remap[old index] = new index like mergeOverlapping(), see ws::permuteByRemap().
+  const std::vector<uint32_t> &reorderMorton()
+  {
+    mortonOrder.compute(objects.size(), [this](size_t ix)
+                        { return objects[ix].pos; });
+    ws::permuteByRemap(objects, mortonOrder.remap);
+    mixedParticles.permute(mortonOrder.remap);
+    return mortonOrder.remap;
   }
 
   void update(float period, int numIter)
+  {
+    const auto run = [&](const auto &law)
+    {
+      const auto computeAccelerations = [&](bool computePotential)
+      {
+        return computePotential ? symmetricAccelerations<true>(law) : symmetricAccelerations<false>(law);
+      };
+      integrate(period, numIter, computeAccelerations);
+    };
+    std::visit(run, forceLaw);
+  }
+
+private:
+  // Sum of fn(begin, end) over the chunks of [0, count), added in chunk order so that it does not depend on scheduling.
+  template <typename Fn>
+  double sumOverChunks(size_t count, Fn &&fn, size_t chunk = chunkSize)
+  {
+    chunkSums.assign((count + chunk - 1) / chunk, 0.0);
+    ws::forEachChunk(threadPool, count, chunk, [&](size_t chunkIx, size_t begin, size_t end)
+                     { chunkSums[chunkIx] = fn(begin, end); });
+    double sum{};
+    for (double chunkSum : chunkSums)
+      sum += chunkSum;
+    return sum;
+  }
+
+  // Adds the acceleration of obj1 due to obj2 and, if WithPotential, their potential energy into pot.
+  template <bool WithPotential, typename Law>
+  static void interact(const Law &law, VerletObject &obj1, const VerletObject &obj2, float &pot)
+  {
+    const glm::vec2 r = obj1.pos - obj2.pos;
+    const forcelaw::PairTerms t = law.evaluate(glm::dot(r, r));
+    obj1.acc += (t.forceScale * obj2.mass) * r;
+    if constexpr (WithPotential)
+      pot += obj1.mass * obj2.mass * t.potential;
+  }
+
+  // Force methods below only write the acc of the objects in their chunk, so chunks can run concurrently without atomics.
+  // They return the potential energy of the system, 0 if !WithPotential.
+  // Exact all-pairs forces evaluating every unordered pair once and applying it to both objects (Newton's third law).
+  // Objects are split into blocks of chunkSize and the pairs into tiles of two blocks. Tiles are scheduled in rounds
+  // (round-robin tournament pairing, then a round of diagonal tiles) in which no two tiles share a block.
+  // A tile sums into its own partial accumulators and adds them to the acc of its two blocks when done,
+  // so tiles of a round run in parallel without write conflicts, and rounds are merged in a fixed order.
+  // The potential is reported over all ordered pairs including self-pairs, like the other methods.
+  template <bool WithPotential, typename Law>
+  double symmetricAccelerations(const Law &law)
+  {
+    const size_t numBlocks = (objects.size() + chunkSize - 1) / chunkSize;
+    const auto blockBegin = [&](size_t b)
+    { return b * chunkSize; };
+    const auto blockEnd = [&](size_t b)
+    { return std::min((b + 1) * chunkSize, objects.size()); };
+
+    const auto tilePotential = [&](size_t bi, size_t bj)
+    {
+      std::array<glm::vec2, chunkSize> accI{};
+      std::array<glm::vec2, chunkSize> accJ{};
+      double pot{};
+      for (size_t i = blockBegin(bi); i < blockEnd(bi); ++i)
+      {
+        const VerletObject &o1 = objects[i];
+        glm::vec2 a1{};
+        float p1{};
+        // on a diagonal tile only j > i, the self-pair contributes potential but no force
+        const size_t jBegin = bi == bj ? i + 1 : blockBegin(bj);
+        if constexpr (WithPotential)
+          if (bi == bj)
+            p1 += 0.5f * o1.mass * o1.mass * law.evaluate(0.0f).potential;
+        for (size_t j = jBegin; j < blockEnd(bj); ++j)
+        {
+          const VerletObject &o2 = objects[j];
+          const glm::vec2 r = o1.pos - o2.pos;
+          const forcelaw::PairTerms t = law.evaluate(glm::dot(r, r));
+          const glm::vec2 f = t.forceScale * r;
+          a1 += f * o2.mass;
+          accJ[j - blockBegin(bj)] -= f * o1.mass;
+          if constexpr (WithPotential)
+            p1 += o1.mass * o2.mass * t.potential;
+        }
+        accI[i - blockBegin(bi)] += a1;
+        // both ordered pairs (i, j) and (j, i)
+        pot += 2.0 * p1;
+      }
+      for (size_t i = blockBegin(bi); i < blockEnd(bi); ++i)
+        objects[i].acc += accI[i - blockBegin(bi)];
+      for (size_t j = blockBegin(bj); j < blockEnd(bj); ++j)
+        objects[j].acc += accJ[j - blockBegin(bj)];
+      return pot;
+    };
+
+    // circle method: with an even number of slots every round pairs up all blocks, slots >= numBlocks are byes
+    const size_t numSlots = numBlocks + numBlocks % 2;
+    double potential{};
+    for (size_t round = 0; round + 1 < numSlots; ++round)
+    {
+      tiles.clear();
+      for (size_t k = 0; k < numSlots / 2; ++k)
+      {
+        const size_t m = numSlots - 1;
+        const size_t a = k == 0 ? m : (round + k) % m;
+        const size_t b = (round + m - k) % m;
+        if (a < numBlocks && b < numBlocks)
+          tiles.emplace_back(std::min(a, b), std::max(a, b));
+      }
+      potential += sumOverChunks(
+          tiles.size(), [&](size_t begin, size_t)
+          { return tilePotential(tiles[begin].first, tiles[begin].second); },
+          1);
+    }
+    potential += sumOverChunks(
+        numBlocks, [&](size_t begin, size_t)
+        { return tilePotential(begin, begin); },
+        1);
+    return potential;
+  }
+
+  template <bool WithPotential, typename Law>
+  double gridAccelerations(const Law &law)
+  {
+    return sumOverChunks(objects.size(), [&](size_t begin, size_t end)
+                         {
+      double chunkPotential{};
+      for (size_t i = begin; i < end; ++i)
+      {
+        VerletObject &obj1 = objects[i];
+        float pot{};
+        const auto interactWith = [&](const VerletObject &obj2)
+        { interact<WithPotential>(law, obj1, obj2, pot); };
+        const auto posIdx = spatialAccelarator.getPosIndex(obj1);
+        for (auto &obj2 : spatialAccelarator.neighborsOf(posIdx))
+          interactWith(obj2);
+        spatialAccelarator.forEachDistantAggregate(posIdx, interactWith);
+        chunkPotential += pot;
+      }
+      return chunkPotential; });
+  }
+
+  template <bool WithPotential, typename Law>
+  double barnesHutAccelerations(const Law &law, float theta)
+  {
+    return sumOverChunks(objects.size(), [&](size_t begin, size_t end)
+                         {
+      double chunkPotential{};
+      for (size_t i = begin; i < end; ++i)
+      {
+        VerletObject &obj1 = objects[i];
+        float pot{};
+        const auto interactWith = [&](const VerletObject &obj2)
+        { interact<WithPotential>(law, obj1, obj2, pot); };
+        quadTree.traverse(objects, obj1.pos, theta, interactWith, interactWith);
+        chunkPotential += pot;
+      }
+      return chunkPotential; });
+  }
+
+  template <bool WithPotential, typename Law>
+  double fmmAccelerations(const Law &law, int order)
+  {
+    // cells per task, cells of a stage are independent
+    constexpr size_t cellChunkSize = 64;
+    fmm.build(objects, order);
+    const int leafLevel = fmm.leafLevel();
+    if constexpr (requires { law.G; })
+    {
+      // SplineSoftened is Newtonian beyond h, i.e. for the well separated cells of the far field as long as they are larger than h
+      float softening2 = 0.0f;
+      if constexpr (requires { law.softening2(); })
+        softening2 = law.softening2();
+      ws::forEachChunk(threadPool, fmm.numCells(leafLevel), cellChunkSize, [&](size_t, size_t begin, size_t end)
+                       { fmm.computeLeafMultipoles(objects, begin, end); });
+      for (int level = leafLevel - 1; level >= 2; --level)
+        ws::forEachChunk(threadPool, fmm.numCells(level), cellChunkSize, [&](size_t, size_t begin, size_t end)
+                         { fmm.translateMultipolesUp(level, begin, end); });
+      for (int level = 2; level <= leafLevel; ++level)
+        ws::forEachChunk(threadPool, fmm.numCells(level), cellChunkSize, [&](size_t, size_t begin, size_t end)
+                         { fmm.computeLocals(level, softening2, begin, end); });
+    }
+    return sumOverChunks(
+        fmm.numCells(leafLevel), [&](size_t begin, size_t end)
+        { return fmm.evaluateLeaves<WithPotential>(objects, law, begin, end); },
+        cellChunkSize);
+  }
+
+  // Splitting scheme skeleton shared by all force computation methods, velocity Verlet unless integrationScheme says otherwise.
+  // computeAccelerations(bool computePotential) has to accumulate a[t + dt] into obj.acc (which is zeroed before the call)
+  // and return the potential energy when asked. Energies are only reported for the end of the last substep.
+  template <typename ComputeAccelerations>
+  void integrate(float period, int numIter, ComputeAccelerations &&computeAccelerations)
   {
     period /= numIter;
     potential = 0.0f;
     kinetic = 0.0f;
+    numForceEvaluations = 0;
+    const integrator::Scheme &scheme = integrationScheme;
     // http://itf.fys.kuleuven.be/~enrico/Teaching/molecular_dynamics.pdf
     // "Note that the [Velocity Verlet] algorithm is identical to that of Eqs. (8) and (9).
     // The difference is that Eq. (9) [this one] is implemented in two steps.
     // The new implementation requires less memory: there is no need to store data at two different time steps."
     for (int n = 0; n < numIter; ++n)
     {
-      // p[t + dt] = p[t] + v[t] dt + 1/2 a dt^2
-      for (VerletObject &obj : objects)
-        obj.pos += obj.vel * period + obj.acc * (period * period * 0.5f);
-
-      // v[t + dt / 2] = v[t] + 1/2 a[t] dt
-      for (VerletObject &obj : objects)
+      const bool isLastIter = n == numIter - 1;
+      for (int k = 0; k < scheme.numStages; ++k)
       {
-        obj.vel += 0.5f * obj.acc * period;
-        // after using acc reset it for the next computation/accumulation
-        obj.acc = {};
-      }
+        const bool isLast = isLastIter && k == scheme.numStages - 1;
+        // the final acceleration of position-form schemes is only needed for energies and to leave acc valid
+        const bool needsAccelerations = scheme.kicks[k] != 0.0f || isLast;
+        const float kick = k == 0 ? scheme.firstKick * period : 0.0f;
+        const float drift = scheme.drifts[k] * period;
+        ws::forEachChunk(threadPool, objects.size(), chunkSize, [&](size_t, size_t begin, size_t end)
+                         {
+          for (size_t i = begin; i < end; ++i)
+          {
+            VerletObject &obj = objects[i];
+            // v[t + c dt] = v[t] + c a[t] dt
+            obj.vel += kick * obj.acc;
+            // p[t + d dt] = p[t] + d v dt
+            obj.pos += drift * obj.vel;
+            // after using acc reset it for the next computation/accumulation
+            if (needsAccelerations)
+              obj.acc = {};
+          } });
+        if (!needsAccelerations)
+          continue;
 
-      // a[t + dt] = 1/m f(p[t + dt])
-      for (size_t i = 0; i < objects.size(); ++i)
-      {
-        for (size_t j = 0; j < objects.size(); ++j)
+        // a[t + dt] = 1/m f(p[t + dt])
+        const double pot = computeAccelerations(isLast);
+        numForceEvaluations += objects.size();
+
+        const float stageKick = scheme.kicks[k] * period;
+        const double kin = sumOverChunks(objects.size(), [&](size_t begin, size_t end)
+                                         {
+          double chunkKinetic{};
+          for (size_t i = begin; i < end; ++i)
+          {
+            VerletObject &obj = objects[i];
+            obj.vel += stageKick * obj.acc;
+            chunkKinetic += 0.5f * obj.mass * glm::dot(obj.vel, obj.vel);
+          }
+          return chunkKinetic; });
+
+        if (isLast)
         {
-          VerletObject &o1 = objects[i];
-          VerletObject &o2 = objects[j];
-          o1.acc -= interObjectForce(o1, o2) / o1.mass;
-          if (interObjectPotential && n == numIter - 1)
-            potential += interObjectPotential(o1, o2);
+          potential = pot;
+          kinetic = kin;
         }
       }
-
-      // v[t + dt] = v[t + dt / 2] + 1/2 a[t + dt] dt
-      for (VerletObject &obj : objects)
-      {
-        obj.vel += 0.5f * obj.acc * period;
-        if (n == numIter - 1)
-          kinetic += 0.5f * obj.mass * glm::dot(obj.vel, obj.vel);
-      }
     }
   }
-};
\ No newline at end of file
+
+  std::vector<double> chunkSums;
+  ws::MortonOrder mortonOrder;
+  // order in which updateMixedPrecision() visits its targets
+  ws::MortonOrder mixedTargetOrder;
+  // objects kicked at the current tick of updateBlockSteps() and their new accelerations
+  std::vector<uint32_t> activeObjects;
+  std::vector<glm::vec2> newAccs;
+  // block pairs of a round of symmetricAccelerations()
+  std::vector<std::pair<size_t, size_t>> tiles;
+  // per chunk overlapping pairs, union-find parents and group sums of mergeOverlapping()
+  std::vector<std::vector<std::pair<uint32_t, uint32_t>>> overlapPairs;
+  std::vector<uint32_t> mergeParents;
+  struct MergeGroup
+  {
+    double mass{};
+    glm::dvec2 pos{}, vel{}, acc{};
+    double volume{};
+    int stepLevel = -1;
+  };
+  std::vector<MergeGroup> mergeGroups;
+};
@@ -0,0 +1,14 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+
+struct VerletObject
+{
+  glm::vec2 pos{};
+  glm::vec2 vel{};
+  float mass = 1.0f;
+  float radius = 0.1f;
+  glm::vec2 acc{};
+  // time step level of Solver::updateBlockSteps(), the object's step is the base step / 2^stepLevel. -1 until assigned.
+  int stepLevel = -1;
+};
@@ -0,0 +1,236 @@
+// Headless benchmark of the graverlet solvers. Builds one of the app's initial conditions, steps it with each requested
+// solver and prints the results as JSON to stdout. No window, OpenGL or ImGui involved.
+//
+// usage: graverlet-bench [--scenario planets|sun-earth-moon] [--n 2000] [--steps 100] [--substeps 2] [--period 0.5]
+//                        [--solver all|exact|soa|approximate|barnes-hut|fmm|block-steps|mixed] [--threads 1]
+//                        [--cell-size 0.1] [--theta 0.5] [--fmm-order 6] [--max-step-level 8] [--step-eta 0.02]
+//                        [--integrator 0] [--seed 0] [--reorder-every 0] [--skip-energy]
+// A step is one Solver update of `period` days in `substeps` substeps, like one frame of the app.
+// With --reorder-every R > 0 objects are sorted along a Z-order curve after every R steps, included in the timings.
+#include "IntegratorBenchmark.h"
+#include "Scenarios.h"
+#include "Verlet.h"
+
+#include <ThreadPool.h>
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+namespace
+{
+  struct Options
+  {
+    std::string scenario = "planets";
+    int n = 2000;
+    int steps = 100;
+    int substeps = 2;
+    float period = 0.5f;
+    std::string solver = "all";
+    int threads = 1;
+    float cellSize = 0.1f;
+    float theta = 0.5f;
+    int fmmOrder = 6;
+    int maxStepLevel = 8;
+    float stepEta = 0.02f;
+    int integratorIx = 0;
+    unsigned seed = 0;
+    int reorderEvery = 0;
+    bool skipEnergy = false;
+  };
+
+  // peak resident set size of the process so far in bytes, 0 if unknown
+  size_t peakRssBytes()
+  {
+#if defined(_WIN32)
+    PROCESS_MEMORY_COUNTERS counters{};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+      return counters.PeakWorkingSetSize;
+    return 0;
+#else
+    rusage usage{};
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+      return 0;
+#if defined(__APPLE__)
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+  }
+
+  bool parseOptions(int argc, char **argv, Options &opt)
+  {
+    for (int i = 1; i < argc; ++i)
+    {
+      const std::string arg = argv[i];
+      const auto next = [&]() -> const char *
+      { return i + 1 < argc ? argv[++i] : nullptr; };
+      const char *value = nullptr;
+      if (arg == "--skip-energy")
+        opt.skipEnergy = true;
+      else if ((value = next()) == nullptr)
+        return false;
+      else if (arg == "--scenario")
+        opt.scenario = value;
+      else if (arg == "--n")
+        opt.n = std::atoi(value);
+      else if (arg == "--steps")
+        opt.steps = std::atoi(value);
+      else if (arg == "--substeps")
+        opt.substeps = std::atoi(value);
+      else if (arg == "--period")
+        opt.period = static_cast<float>(std::atof(value));
+      else if (arg == "--solver")
+        opt.solver = value;
+      else if (arg == "--threads")
+        opt.threads = std::atoi(value);
+      else if (arg == "--cell-size")
+        opt.cellSize = static_cast<float>(std::atof(value));
+      else if (arg == "--theta")
+        opt.theta = static_cast<float>(std::atof(value));
+      else if (arg == "--fmm-order")
+        opt.fmmOrder = std::atoi(value);
+      else if (arg == "--max-step-level")
+        opt.maxStepLevel = std::atoi(value);
+      else if (arg == "--step-eta")
+        opt.stepEta = static_cast<float>(std::atof(value));
+      else if (arg == "--integrator")
+        opt.integratorIx = std::atoi(value);
+      else if (arg == "--seed")
+        opt.seed = static_cast<unsigned>(std::atoi(value));
+      else if (arg == "--reorder-every")
+        opt.reorderEvery = std::atoi(value);
+      else
+        return false;
+    }
+    return opt.steps > 0 && opt.substeps > 0 && opt.n >= 0 && opt.threads > 0 && opt.reorderEvery >= 0 &&
+           opt.integratorIx >= 0 && opt.integratorIx < static_cast<int>(integrator::schemes.size()) &&
+           (opt.scenario == "planets" || opt.scenario == "sun-earth-moon");
+  }
+
+  struct SolverRun
+  {
+    const char *name;
+    void (*step)(Solver &solver, const Options &opt);
+  };
+
+  const SolverRun solverRuns[] = {
+      {"exact", [](Solver &s, const Options &o)
+       { s.update(o.period, o.substeps); }},
+      {"soa", [](Solver &s, const Options &o)
+       { s.updateSoA(o.period, o.substeps); }},
+      {"approximate", [](Solver &s, const Options &o)
+       { s.updateOptimized(o.period, o.substeps, o.cellSize); }},
+      {"barnes-hut", [](Solver &s, const Options &o)
+       { s.updateBarnesHut(o.period, o.substeps, o.theta); }},
+      {"fmm", [](Solver &s, const Options &o)
+       { s.updateFmm(o.period, o.substeps, o.fmmOrder); }},
+      {"block-steps", [](Solver &s, const Options &o)
+       { s.updateBlockSteps(o.period, o.substeps, o.maxStepLevel, o.stepEta); }},
+      {"mixed", [](Solver &s, const Options &o)
+       { s.updateMixedPrecision(o.period, o.substeps); }},
+  };
+} // namespace
+
+int main(int argc, char **argv)
+{
+  Options opt;
+  if (!parseOptions(argc, argv, opt))
+  {
+    std::fprintf(stderr, "usage: %s [--scenario planets|sun-earth-moon] [--n N] [--steps S] [--substeps K] [--period DAYS]\n"
+                         "  [--solver all|exact|soa|approximate|barnes-hut|fmm|block-steps|mixed] [--threads T] [--cell-size C] [--theta T]\n"
+                         "  [--fmm-order P] [--max-step-level L] [--step-eta E] [--integrator 0-3] [--seed S] [--reorder-every R]\n"
+                         "  [--skip-energy]\n",
+                 argv[0]);
+    return 1;
+  }
+
+  std::vector<VerletObject> initialObjects;
+  if (opt.scenario == "planets")
+  {
+    std::mt19937 rndGen(opt.seed);
+    std::uniform_real_distribution<float> rndDist;
+    initialObjects = scenarios::sunWithPlanets(opt.n, 1.0f, rndGen, rndDist);
+  }
+  else
+    initialObjects = scenarios::sunEarthMoon();
+
+  const ForceLaw forceLaw = forcelaw::Newtonian{constants::G0, 0.000001f};
+  std::unique_ptr<ws::ThreadPool> threadPool;
+  if (opt.threads > 1)
+    threadPool = std::make_unique<ws::ThreadPool>(opt.threads);
+  const double initialEnergy = opt.skipEnergy ? 0.0 : conservedEnergy(initialObjects, forceLaw);
+  const double numObjects = static_cast<double>(initialObjects.size());
+
+  std::printf("{\n");
+  std::printf("  \"scenario\": \"%s\",\n", opt.scenario.c_str());
+  std::printf("  \"num_objects\": %zu,\n", initialObjects.size());
+  std::printf("  \"steps\": %d,\n", opt.steps);
+  std::printf("  \"substeps\": %d,\n", opt.substeps);
+  std::printf("  \"period\": %g,\n", opt.period);
+  std::printf("  \"threads\": %d,\n", opt.threads);
+  std::printf("  \"integrator\": \"%s\",\n", integrator::schemes[opt.integratorIx].name);
+  std::printf("  \"reorder_every\": %d,\n", opt.reorderEvery);
+  std::printf("  \"simd\": \"%s\",\n", gravity::simdPathName);
+  std::printf("  \"results\": [");
+  bool isFirst = true;
+  for (const SolverRun &run : solverRuns)
+  {
+    if (opt.solver != "all" && opt.solver != run.name)
+      continue;
+
+    std::vector<VerletObject> objects = initialObjects;
+    Solver solver(objects, forceLaw);
+    solver.threadPool = threadPool.get();
+    solver.integrationScheme = integrator::schemes[opt.integratorIx];
+
+    size_t numForceEvaluations{};
+    const auto start = std::chrono::steady_clock::now();
+    for (int n = 0; n < opt.steps; ++n)
+    {
+      run.step(solver, opt);
+      numForceEvaluations += solver.numForceEvaluations;
+      if (opt.reorderEvery > 0 && (n + 1) % opt.reorderEvery == 0)
+        solver.reorderMorton();
+    }
+    const std::chrono::duration<double> duration = std::chrono::steady_clock::now() - start;
+    const double seconds = duration.count();
+
+    // time per interaction an all-pairs solver would compute, N per force evaluation, so that methods are comparable
+    const double interactions = static_cast<double>(numForceEvaluations) * numObjects;
+    std::printf("%s\n    {\n", isFirst ? "" : ",");
+    isFirst = false;
+    std::printf("      \"solver\": \"%s\",\n", run.name);
+    std::printf("      \"seconds\": %.6f,\n", seconds);
+    // JSON has no inf, a run too short to time has no rate
+    if (seconds > 0)
+      std::printf("      \"steps_per_sec\": %.6g,\n", opt.steps / seconds);
+    else
+      std::printf("      \"steps_per_sec\": null,\n");
+    std::printf("      \"force_evaluations\": %zu,\n", numForceEvaluations);
+    std::printf("      \"ns_per_interaction\": %.6g,\n", interactions > 0 ? seconds * 1e9 / interactions : 0.0);
+    if (opt.skipEnergy)
+      std::printf("      \"energy_drift\": null\n");
+    else
+      std::printf("      \"energy_drift\": %.6e\n", std::abs((conservedEnergy(objects, forceLaw) - initialEnergy) / initialEnergy));
+    std::printf("    }");
+  }
+  std::printf("\n  ],\n");
+  // of the whole process, the largest footprint of any solver that ran. Run one solver per invocation to compare them.
+  std::printf("  \"peak_rss_bytes\": %zu\n}\n", peakRssBytes());
+  return 0;
+}
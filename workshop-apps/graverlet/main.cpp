@@ -13,6 +13,10 @@
  * G = 6.674 10^−11 m^3 / kg s^2
  * choose T0 one day, M0 earth's mass, R0 distance between earth and sun
  */
+#include "Checkpoint.h"
+#include "IntegratorBenchmark.h"
+#include "Scenarios.h"
+#include "Trajectory.h"
 #include "Verlet.h"
 #include "plots.h"
 
@@ -21,7 +25,11 @@
 #include <Camera.h>
 #include <CameraController.h>
 #include <Mesh.h>
+#include <MortonOrder.h>
 #include <Shader.h>
+#include <SpscQueue.h>
+#include <ThreadPool.h>
+#include <TripleBuffer.h>
 
 #include <glad/gl.h>
 #include <glm/vec2.hpp>
@@ -30,54 +38,25 @@
 #include <glm/gtc/type_ptr.hpp>
 #include <imgui.h>
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <chrono>
 #include <cmath>
 #include <functional>
 #include <unordered_map>
 #include <memory>
+#include <numeric>
 #include <random>
+#include <thread>
 #include <vector>
 
 // https://home.ifa.hawaii.edu/users/barnes/research/smoothing/soft.pdf
 float softening = 0.000001f;
-
-namespace constants
-{
-  // T0: 1 day in seconds
-  const float T0 = 24 * 60 * 60;
-
-  // M0: Earth's mass in kg
-  // https://en.wikipedia.org/wiki/Earth_mass
-  const float M0 = 5.972e24f;
-
-  // R0: // distance from earth to sun in meters = 1 AU = 150 Mkm (varies 3% throughout the year)
-  // https://en.wikipedia.org/wiki/Astronomical_unit
-  const float R0 = 150e9f;
-
-  // G: gravitational constant G in m^3 / kg s^2
-  // https://en.wikipedia.org/wiki/Gravitational_constant
-  const float GG = 6.674e-11f;
-
-  // G0: unitless gravitational constant = 8.81576e-10
-  const float G0 = GG * M0 * std::pow(T0, 2.f) / std::pow(R0, 3.f);
-
-  const float R_AU = 1.0f;
-
-  const float M_Earth = 1.0f;
-
-  // Sun's mass is 333030 M0
-  const float M_Sun = 333030.0f;
-
-  // Earth's speed = 29.78 km/s
-  // https://en.wikipedia.org/wiki/Earth%27s_orbit
-  const float V_Earth_Sun = 2.978e4f * T0 / R0;
-
-  // Moon's speed around Earth: 1.022km/s
-  // https://en.wikipedia.org/wiki/Orbit_of_the_Moon
-  const float V_Moon_Earth = 1022 * T0 / R0;
-  const float R_Moon_Earth = 0.00257f;
-  const float M_Moon = 1.0f / 82;
-} // namespace constants
+// smallest softening and softening length accepted from the UI and checkpoints. At 0 particles at the same position,
+// e.g. a particle and itself, have an infinite potential.
+constexpr float minSoftening = 1e-8f;
+constexpr float minSofteningLength = 1e-6f;
 
 // clang-format off
 // https://stackoverflow.com/questions/21977786/star-b-v-color-index-to-apparent-rgb-color
@@ -114,18 +93,31 @@ public:
   std::unique_ptr<ws::Camera2D> camera;
   std::unique_ptr<ws::Camera2DController> camController;
 
-  InterForce gravitationalForce = [](const VerletObject &obj1, const VerletObject &obj2)
+  // index of the selected alternative of ForceLaw and parameters of the laws
+  int forceLawIx = 0;
+  float softeningLength = 0.001f;
+  float ljEpsilon = 1e-9f;
+  float ljSigma = 0.002f;
+
+  ForceLaw makeForceLaw() const
   {
-    glm::vec2 r = obj1.pos - obj2.pos;
-    const float r2 = glm::dot(r, r);
-    return constants::G0 * obj1.mass * obj2.mass * r / glm::pow(r2 + softening, 1.5f);
-  };
+    switch (forceLawIx)
+    {
+    case 1:
+      return forcelaw::Plummer{constants::G0, softeningLength};
+    case 2:
+      return forcelaw::SplineSoftened{constants::G0, softeningLength};
+    case 3:
+      return forcelaw::LennardJones{ljEpsilon, ljSigma};
+    default:
+      return forcelaw::Newtonian{constants::G0, softening};
+    }
+  }
 
-  InterPotential gravitationalPotential = [](const VerletObject &obj1, const VerletObject &obj2)
+  InterPotential selectedPotential = [this](const VerletObject &obj1, const VerletObject &obj2)
   {
-    glm::vec2 r = obj1.pos - obj2.pos;
-    const float r2 = glm::dot(r, r);
-    return -constants::G0 * obj1.mass * obj2.mass / glm::pow(r2 + softening, 0.5f);
+    // not the solver's law, which the simulation thread may be replacing
+    return pairPotential(makeForceLaw(), obj1, obj2);
   };
 
   InterPotential gravitationalPotentialOriginal = [](const VerletObject &obj1, const VerletObject &obj2)
@@ -135,33 +127,515 @@ public:
     return -constants::G0 * obj1.mass * obj2.mass / glm::pow(r2, 0.5f);
   };
 
-  std::mt19937 rndGen;
-  std::uniform_real_distribution<float> rndDist;
+  enum SolverMethod
+  {
+    Exact,
+    ExactSoA,
+    Approximate,
+    BarnesHut,
+    FastMultipole,
+    BlockSteps,
+    ExactMixed,
+  };
+  static_assert(SolverMethod::ExactMixed + 1 == checkpoint::numSolverMethods);
+  int solverMethod = SolverMethod::Exact;
+  float cellSize = 0.1f;
+  float theta = 0.5f;
+  int numIter = 2;
+  int fmmOrder = 6;
+  int maxStepLevel = 8;
+  // index into integrator::schemes
+  int integratorIx = 0;
+  std::vector<IntegratorBenchmarkResult> integratorBenchmarkResults;
+  float stepEta = 0.02f;
 
-  MyApp() : App({.name = "MyApp", .width = 800u, .height = 800u, .shouldDebugOpenGL = true}) {}
+  // solver->threadPool, recreated when the number of threads is changed in the UI
+  std::unique_ptr<ws::ThreadPool> threadPool;
+  int numThreads = static_cast<int>(ws::ThreadPool::defaultNumThreads());
+  // results of the last "Measure Speed-up", in ms per step
+  float serialStepMs = 0.0f;
+  float parallelStepMs = 0.0f;
 
-  void setupSolarSystemFilledWithPlanets(int numObjects, float speedFactor)
+  // UI parameters a step depends on. Copied as a whole so that the simulation thread never reads the UI's members.
+  struct SimulationSettings
+  {
+    int solverMethod{};
+    float cellSize{};
+    float theta{};
+    int numIter{};
+    int fmmOrder{};
+    int maxStepLevel{};
+    float stepEta{};
+    int integratorIx{};
+    ForceLaw forceLaw;
+    float speed{};
+    bool mergeOverlapping{};
+    int reorderEvery{};
+
+    bool operator==(const SimulationSettings &) const = default;
+  };
+
+  SimulationSettings currentSettings() const
+  {
+    return {solverMethod, cellSize, theta, numIter, fmmOrder, maxStepLevel, stepEta, integratorIx, makeForceLaw(), speed, mergeOverlapping, reorderEvery};
+  }
+
+  static void stepSolver(Solver &s, const SimulationSettings &settings, float period)
+  {
+    switch (settings.solverMethod)
+    {
+    case SolverMethod::Exact:
+      s.update(period, settings.numIter);
+      break;
+    case SolverMethod::ExactSoA:
+      s.updateSoA(period, settings.numIter);
+      break;
+    case SolverMethod::Approximate:
+      s.updateOptimized(period, settings.numIter, settings.cellSize);
+      break;
+    case SolverMethod::BarnesHut:
+      s.updateBarnesHut(period, settings.numIter, settings.theta);
+      break;
+    case SolverMethod::FastMultipole:
+      s.updateFmm(period, settings.numIter, settings.fmmOrder);
+      break;
+    case SolverMethod::BlockSteps:
+      s.updateBlockSteps(period, settings.numIter, settings.maxStepLevel, settings.stepEta);
+      break;
+    case SolverMethod::ExactMixed:
+      s.updateMixedPrecision(period, settings.numIter);
+      break;
+    }
+  }
+
+  // Times steps of the current method on a copy of the objects without, then with, the thread pool.
+  // Both runs start from the same state and do the same work, results are identical.
+  void measureSpeedUp(float period)
+  {
+    const auto msPerStep = [&](ws::ThreadPool *pool)
+    {
+      std::vector<VerletObject> probeObjects = objects;
+      Solver probe(probeObjects, solver->forceLaw, false);
+      probe.threadPool = pool;
+      const SimulationSettings settings = currentSettings();
+      const int numSteps = 10;
+      const auto start = std::chrono::steady_clock::now();
+      for (int n = 0; n < numSteps; ++n)
+        stepSolver(probe, settings, period);
+      const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+      return duration.count() / numSteps;
+    };
+    serialStepMs = msPerStep(nullptr);
+    parallelStepMs = msPerStep(threadPool.get());
+  }
+
+  // results of the last "Validate FMM": RMS of |a_fmm - a_exact| / |a_exact| over objects, ms per step of both solvers
+  float fmmRmsRelativeError = -1.0f;
+  float fmmStepMs = 0.0f;
+  float exactStepMs = 0.0f;
+
+  // Compares FMM accelerations at the current positions against the exact solver's, then times a step of each.
+  // Runs on copies of the objects, the simulation is not affected.
+  void validateFmm(float period)
   {
-    objects.clear();
-    objects.emplace_back(VerletObject{{0, 0}, {0, 0}, constants::M_Sun, 0.05f, {}});
-    for (int n = 0; n < numObjects; n++)
+    std::vector<VerletObject> exactObjects = objects;
+    std::vector<VerletObject> fmmObjects = objects;
+    Solver exact(exactObjects, solver->forceLaw, false);
+    Solver fmm(fmmObjects, solver->forceLaw, false);
+    exact.threadPool = fmm.threadPool = threadPool.get();
+    // a step of zero length recomputes accelerations without moving anything
+    exact.update(0.0f, 1);
+    fmm.updateFmm(0.0f, 1, fmmOrder);
+    double sumSquares{};
+    for (size_t ix = 0; ix < objects.size(); ++ix)
+    {
+      const glm::vec2 diff = fmmObjects[ix].acc - exactObjects[ix].acc;
+      const float exactAcc2 = glm::dot(exactObjects[ix].acc, exactObjects[ix].acc);
+      if (exactAcc2 > 0.0f)
+        sumSquares += glm::dot(diff, diff) / exactAcc2;
+    }
+    fmmRmsRelativeError = static_cast<float>(std::sqrt(sumSquares / std::max<size_t>(objects.size(), 1)));
+
+    const auto msPerStep = [&](const auto &step)
     {
-      const float r = constants::R_AU * rndDist(rndGen);
-      glm::vec2 p{};
+      const auto start = std::chrono::steady_clock::now();
+      step();
+      const std::chrono::duration<float, std::milli> duration = std::chrono::steady_clock::now() - start;
+      return duration.count();
+    };
+    fmmStepMs = msPerStep([&]
+                          { fmm.updateFmm(period, numIter, fmmOrder); });
+    exactStepMs = msPerStep([&]
+                            { exact.update(period, numIter); });
+  }
+
+  // Energy drift vs force evaluations of every integrator on both setups, exact forces.
+  // Sun, Earth, Moon for a year; N planets (with the current Num Objects and Speed Factor) for 10 days, which needs more steps.
+  void runIntegratorBenchmark(int numObjects, float speedFactor)
+  {
+    integratorBenchmarkResults.clear();
+    benchmarkIntegrators("Sun, Earth, Moon", scenarios::sunEarthMoon(), solver->forceLaw, 365, {1, 4, 16}, threadPool.get(), integratorBenchmarkResults);
+    // own generator so that runs are comparable
+    std::mt19937 benchmarkRndGen;
+    std::uniform_real_distribution<float> benchmarkRndDist;
+    const std::vector<VerletObject> planets = scenarios::sunWithPlanets(numObjects, speedFactor, benchmarkRndGen, benchmarkRndDist);
+    benchmarkIntegrators("Sun with N planets", planets, solver->forceLaw, 10, {16, 64, 256}, threadPool.get(), integratorBenchmarkResults);
+  }
+
+  // simulated days since start, time stamp of recorded frames
+  double simTime = 0.0;
+  size_t numSteps = 0;
+  trajectory::Recorder recorder;
+  trajectory::Player player;
+  // drawn instead of mesh while a trajectory file is open
+  std::unique_ptr<ws::Mesh> playbackMesh;
+  char trajectoryPath[256] = "graverlet.traj";
+  int trajectoryEncodingIx = 0;
+  int recordEvery = 1;
+  int playbackFrame = 0;
+  bool isPlaying = false;
+
+  void openPlayback()
+  {
+    if (!player.open(trajectoryPath))
+      return;
+    const size_t n = player.getNumObjects();
+    playbackMesh = std::make_unique<ws::Mesh>(n, ws::Mesh::Type::Points);
+    // keep the colors of the simulation if the file has as many objects, e.g. it was just recorded
+    const bool hasColors = mesh && mesh->verts.size() == n;
+    for (uint32_t ix = 0; ix < n; ++ix)
+    {
+      const glm::vec4 color = hasColors ? mesh->verts[ix].color : glm::vec4{1, 1, 1, 1};
+      playbackMesh->verts[ix] = ws::DefaultVertex{{}, {}, {}, color, {player.getRadius(ix), 0, 0, 0}};
+      playbackMesh->idxs[ix] = ix;
+    }
+    playbackFrame = 0;
+    showPlaybackFrame();
+  }
+
+  void showPlaybackFrame()
+  {
+    if (player.getNumFrames() == 0)
+      return;
+    playbackFrame = std::clamp(playbackFrame, 0, static_cast<int>(player.getNumFrames()) - 1);
+    player.forEachObject(playbackFrame, [&](size_t ix, glm::vec2 pos, glm::vec2)
+                         { playbackMesh->verts[ix].position = {pos.x, pos.y, 0}; });
+    playbackMesh->uploadData();
+  }
+
+  // merge overlapping objects after every step, see Solver::mergeOverlapping()
+  bool mergeOverlapping = false;
+  size_t numMerged = 0;
+  std::vector<uint32_t> mergeRemap;
+  // indices of objects referred to by the UI, remapped when objects merge or are reordered
+  int selObjIx = 0;
+  int objIx = -1;
+
+  void remapUiIndices(const std::vector<uint32_t> &remap)
+  {
+    const auto remapIx = [&](int &ix)
+    {
+      if (ix >= 0 && ix < static_cast<int>(remap.size()))
+        ix = static_cast<int>(remap[ix]);
+    };
+    remapIx(selObjIx);
+    remapIx(objIx);
+  }
+
+  // Merges overlapping objects and compacts the mesh and the UI's object indices along with them
+  void mergeObjects()
+  {
+    const size_t numRemoved = solver->mergeOverlapping(mergeRemap);
+    if (numRemoved == 0)
+      return;
+    numMerged += numRemoved;
+    compactByRemap(mesh->verts, mergeRemap);
+    mesh->idxs.resize(objects.size());
+    for (size_t ix = 0; const auto &obj : objects)
+      mesh->verts[ix++].custom1.x = obj.radius;
+    remapUiIndices(mergeRemap);
+    // trajectory files have a fixed number of objects
+    recorder.close();
+  }
+
+  // objects are sorted along a Z-order curve every this many steps, 0 never, see Solver::reorderMorton()
+  int reorderEvery = 60;
+  int numStepsSinceReorder = 0;
+
+  // Whether the objects are due for reordering after this step. Not while recording, trajectory files have a fixed order.
+  bool shouldReorder(int every)
+  {
+    if (every <= 0 || recorder.isOpen() || ++numStepsSinceReorder < every)
+      return false;
+    numStepsSinceReorder = 0;
+    return true;
+  }
+
+  // Reorders the objects, their vertices keep following them, as do the UI's object indices
+  void reorderObjects()
+  {
+    const std::vector<uint32_t> &remap = solver->reorderMorton();
+    ws::permuteByRemap(mesh->verts, remap);
+    remapUiIndices(remap);
+  }
+
+  // days simulated per second of real time
+  float speed = 30.0f;
+  char checkpointPath[256] = "graverlet.ckpt";
+
+  void saveCheckpoint()
+  {
+    const checkpoint::Settings settings{solverMethod, numIter, fmmOrder, maxStepLevel, integratorIx, forceLawIx,
+                                        cellSize, theta, stepEta, softening, softeningLength, ljEpsilon, ljSigma, speed, simTime};
+    std::vector<glm::vec4> colors(objects.size());
+    for (size_t ix = 0; ix < objects.size() && ix < mesh->verts.size(); ++ix)
+      colors[ix] = mesh->verts[ix].color;
+    checkpoint::save(checkpointPath, settings, objects, colors, rndGen);
+  }
+
+  // Replaces the simulation with the snapshot. Accelerations come from the file, the new solver skips its O(N^2) initial pass.
+  void loadCheckpoint()
+  {
+    checkpoint::Settings s;
+    std::vector<glm::vec4> colors;
+    if (!checkpoint::load(checkpointPath, s, objects, colors, rndGen))
+      return;
+    solverMethod = s.solverMethod;
+    numIter = s.numIter;
+    fmmOrder = s.fmmOrder;
+    maxStepLevel = s.maxStepLevel;
+    integratorIx = s.integratorIx;
+    forceLawIx = s.forceLawIx;
+    cellSize = s.cellSize;
+    theta = s.theta;
+    stepEta = s.stepEta;
+    softening = std::max(s.softening, minSoftening);
+    softeningLength = std::max(s.softeningLength, minSofteningLength);
+    ljEpsilon = s.ljEpsilon;
+    ljSigma = s.ljSigma;
+    speed = s.speed;
+    simTime = s.simTime;
+
+    mesh = std::make_unique<ws::Mesh>(objects.size(), ws::Mesh::Type::Points);
+    for (uint32_t ix = 0; const auto &obj : objects)
+    {
+      mesh->verts[ix] = ws::DefaultVertex{{obj.pos.x, obj.pos.y, 0}, {}, {}, colors[ix], {obj.radius, 0, 0, 0}};
+      mesh->idxs[ix] = ix;
+      ix++;
+    }
+    mesh->uploadData();
+    solver = std::make_unique<Solver>(objects, makeForceLaw(), false);
+    solver->threadPool = threadPool.get();
+    solver->integrationScheme = integrator::schemes[integratorIx];
+  }
+
+  // What the simulation thread publishes after every step, all that rendering and the UI need of the simulation
+  struct SimulationSnapshot
+  {
+    std::vector<glm::vec2> positions;
+    std::vector<float> radii;
+    // index every object had when the thread started
+    std::vector<uint32_t> ids;
+    // current index of the object each id is part of, for following the UI's objects through merges and reorders
+    std::vector<uint32_t> ixOfId;
+    // incremented whenever ids change, i.e. objects merged or were reordered
+    size_t layoutVersion{};
+    double potential{};
+    double kinetic{};
+    double simTime{};
+    size_t numForceEvaluations{};
+    int finestStepLevel{};
+    size_t numMerged{};
+    bool isRecording{};
+    size_t numRecordedFrames{};
+    size_t numDroppedFrames{};
+    float stepsPerSecond{};
+  };
+
+  // Steps the simulation on its own thread instead of once per frame. Frames then only draw the latest snapshot,
+  // and a slow solver no longer holds back the UI. Anything else that touches objects or solver pauses the thread first.
+  bool useSimulationThread = false;
+  std::thread simulationThread;
+  std::atomic<bool> shouldStopSimulation{false};
+  ws::TripleBuffer<SimulationSnapshot> snapshots;
+  ws::SpscQueue<SimulationSettings, 64> settingsQueue;
+  SimulationSettings sentSettings;
+  // owned by the simulation thread while it runs, see SimulationSnapshot
+  std::vector<uint32_t> objectIds;
+  std::vector<uint32_t> ixOfId;
+  size_t layoutVersion{};
+  size_t shownLayoutVersion{};
+  // colors of the objects when the thread started, indexed by id, and ids of the objects in mesh
+  std::vector<glm::vec4> idColors;
+  std::vector<uint32_t> shownIds;
+
+  void simulationLoop(SimulationSettings settings)
+  {
+    using Clock = std::chrono::steady_clock;
+    auto lastStep = Clock::now();
+    auto rateStart = lastStep;
+    int numRateSteps = 0;
+    float stepsPerSecond = 0.0f;
+    while (!shouldStopSimulation.load(std::memory_order_relaxed))
+    {
+      while (const std::optional<SimulationSettings> changed = settingsQueue.pop())
+        settings = *changed;
+      // takes effect at the next update, which dispatches on it once
+      solver->forceLaw = settings.forceLaw;
+      solver->integrationScheme = integrator::schemes[settings.integratorIx];
+
+      // a step advances by the real time since the previous one, at most a tenth of a second of it so that a stall
+      // doesn't turn into one huge step, and at most a thousand steps per second so that tiny N doesn't spin the core
+      auto now = Clock::now();
+      const auto minStepDuration = std::chrono::milliseconds(1);
+      if (now - lastStep < minStepDuration)
+      {
+        std::this_thread::sleep_for(minStepDuration - (now - lastStep));
+        now = Clock::now();
+      }
+      const float period = std::min(std::chrono::duration<float>(now - lastStep).count(), 0.1f) * settings.speed;
+      lastStep = now;
+
+      stepSolver(*solver, settings, period);
+      if (settings.mergeOverlapping)
       {
-        const float theta = 2.0f * 3.14159265f * rndDist(rndGen);
-        const float x = r * std::cos(theta);
-        const float y = r * std::sin(theta);
-        p = {x, y};
+        const size_t numRemoved = solver->mergeOverlapping(mergeRemap);
+        if (numRemoved > 0)
+        {
+          numMerged += numRemoved;
+          compactByRemap(objectIds, mergeRemap);
+          for (uint32_t &ix : ixOfId)
+            ix = mergeRemap[ix];
+          ++layoutVersion;
+          recorder.close();
+        }
       }
-      glm::vec2 v{};
+      if (shouldReorder(settings.reorderEvery))
       {
-        const float speed = constants::V_Earth_Sun / std::sqrt(r);
-        v = glm::normalize(glm::vec2{-p.y, p.x}) * speed * speedFactor;
+        const std::vector<uint32_t> &remap = solver->reorderMorton();
+        ws::permuteByRemap(objectIds, remap);
+        for (uint32_t &ix : ixOfId)
+          ix = remap[ix];
+        ++layoutVersion;
       }
+      simTime += period;
+      if (recorder.isOpen() && ++numSteps % recordEvery == 0)
+        recorder.record(objects, simTime);
 
-      objects.emplace_back(VerletObject{p, v, 1.5f, 0.01f});
+      ++numRateSteps;
+      const std::chrono::duration<float> rateDuration = now - rateStart;
+      if (rateDuration.count() >= 0.5f)
+      {
+        stepsPerSecond = static_cast<float>(numRateSteps) / rateDuration.count();
+        numRateSteps = 0;
+        rateStart = now;
+      }
+
+      SimulationSnapshot &snap = snapshots.getWriteBuffer();
+      snap.positions.resize(objects.size());
+      snap.radii.resize(objects.size());
+      for (size_t ix = 0; const auto &obj : objects)
+      {
+        snap.positions[ix] = obj.pos;
+        snap.radii[ix++] = obj.radius;
+      }
+      snap.ids = objectIds;
+      snap.ixOfId = ixOfId;
+      snap.layoutVersion = layoutVersion;
+      snap.potential = solver->potential;
+      snap.kinetic = solver->kinetic;
+      snap.simTime = simTime;
+      snap.numForceEvaluations = solver->numForceEvaluations;
+      snap.finestStepLevel = solver->finestStepLevel;
+      snap.numMerged = numMerged;
+      snap.isRecording = recorder.isOpen();
+      snap.numRecordedFrames = recorder.getNumFrames();
+      snap.numDroppedFrames = recorder.getNumDroppedFrames();
+      snap.stepsPerSecond = stepsPerSecond;
+      snapshots.publish();
     }
+  }
+
+  bool isSimulationThreadRunning() const { return simulationThread.joinable(); }
+
+  void startSimulationThread()
+  {
+    if (isSimulationThreadRunning())
+      return;
+    objectIds.resize(objects.size());
+    std::iota(objectIds.begin(), objectIds.end(), 0u);
+    ixOfId = shownIds = objectIds;
+    layoutVersion = shownLayoutVersion = 0;
+    idColors.resize(mesh->verts.size());
+    for (size_t ix = 0; const auto &vert : mesh->verts)
+      idColors[ix++] = vert.color;
+    // the queue is only read by the thread, which is not running, nothing is pending
+    while (settingsQueue.pop())
+      ;
+    sentSettings = currentSettings();
+    shouldStopSimulation = false;
+    simulationThread = std::thread(&MyApp::simulationLoop, this, sentSettings);
+  }
+
+  // Joins the thread and shows its final state. Returns whether it was running.
+  bool stopSimulationThread()
+  {
+    if (!isSimulationThreadRunning())
+      return false;
+    shouldStopSimulation = true;
+    simulationThread.join();
+    if (snapshots.update())
+      showSnapshot(snapshots.getReadBuffer());
+    return true;
+  }
+
+  // Runs fn with the simulation thread stopped, for anything that reads or replaces objects or solver
+  template <typename Fn>
+  void withSimulationPaused(Fn &&fn)
+  {
+    const bool wasRunning = stopSimulationThread();
+    fn();
+    if (wasRunning)
+      startSimulationThread();
+  }
+
+  void showSnapshot(const SimulationSnapshot &snap)
+  {
+    const size_t n = snap.positions.size();
+    // objects merged or were reordered, they keep their color and the UI's indices move with them
+    if (mesh->verts.size() != n || snap.layoutVersion != shownLayoutVersion)
+    {
+      const auto remapIx = [&](int &ix)
+      {
+        if (ix >= 0 && ix < static_cast<int>(shownIds.size()))
+          ix = static_cast<int>(snap.ixOfId[shownIds[ix]]);
+      };
+      remapIx(selObjIx);
+      remapIx(objIx);
+      shownIds = snap.ids;
+      shownLayoutVersion = snap.layoutVersion;
+      mesh->verts.resize(n);
+      mesh->idxs.resize(n);
+      for (size_t ix = 0; ix < n; ++ix)
+      {
+        mesh->verts[ix].color = idColors[snap.ids[ix]];
+        mesh->verts[ix].custom1.x = snap.radii[ix];
+        mesh->idxs[ix] = static_cast<uint32_t>(ix);
+      }
+    }
+    for (size_t ix = 0; const auto &pos : snap.positions)
+      mesh->verts[ix++].position = {pos.x, pos.y, 0};
+    mesh->uploadData();
+  }
+
+  std::mt19937 rndGen;
+  std::uniform_real_distribution<float> rndDist;
+
+  MyApp() : App({.name = "MyApp", .width = 800u, .height = 800u, .shouldDebugOpenGL = true}) {}
+
+  void setupSolarSystemFilledWithPlanets(int numObjects, float speedFactor)
+  {
+    objects = scenarios::sunWithPlanets(numObjects, speedFactor, rndGen, rndDist);
 
     mesh = std::make_unique<ws::Mesh>(objects.size(), ws::Mesh::Type::Points);
     for (uint32_t ix = 0; const auto &obj : objects)
@@ -177,18 +651,7 @@ public:
 
   void setupSunEarthMoon()
   {
-    objects.clear();
-    // Add sun
-    objects.emplace_back(VerletObject{{0, 0}, {0, 0}, constants::M_Sun, 0.05f, {}});
-    // Add earth
-    objects.emplace_back(VerletObject{{constants::R_AU, 0}, {0, constants::V_Earth_Sun}, constants::M_Earth, 0.002f, {}});
-    // Add moon
-    objects.emplace_back(VerletObject{{constants::R_AU - constants::R_Moon_Earth, 0}, {0, constants::V_Earth_Sun - constants::V_Moon_Earth}, constants::M_Moon, 0.0002f, {}});
-
-    // Earth+Moon only
-    // objects.emplace_back(VerletObject{{0, 0}, {0, 0}, constants::M_Earth, 0.002f, {}});
-    // objects.emplace_back(VerletObject{{0.00257, 0}, {0, constants::V_Moon}, 1.0f / 82, 0.0002f, {}});
-
+    objects = scenarios::sunEarthMoon();
     mesh = std::make_unique<ws::Mesh>(objects.size(), ws::Mesh::Type::Points);
     for (uint32_t ix = 0; const auto &obj : objects)
     {
@@ -210,7 +673,9 @@ public:
                                               GS_ASSETS_FOLDER / "shaders/graverlet/line.frag");
 
     setupSunEarthMoon();
-    solver = std::make_unique<Solver>(objects, gravitationalForce, gravitationalPotential);
+    solver = std::make_unique<Solver>(objects, makeForceLaw());
+    threadPool = std::make_unique<ws::ThreadPool>(numThreads);
+    solver->threadPool = threadPool.get();
 
     camera = std::make_unique<ws::Camera2D>(2.5f, 2.5f);
     camController = std::make_unique<ws::Camera2DController>(*camera);
@@ -231,25 +696,50 @@ public:
     glClearColor(0.2f, 0.3f, 0.3f, 1.0f);
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-    static float cellSize = 0.1f;
-
-    static float speed = 30.0f;
-    static int numIter = 2;
     float period = deltaTime * speed;
-    static bool useApproximation = false;
-    SpatialAccelarator *sa = nullptr;
-    if (!useApproximation)
+    static bool showAccGrid = true;
+    // the simulation pauses while a trajectory is played back
+    const bool shouldRunThread = useSimulationThread && !player.isOpen();
+    if (shouldRunThread && !isSimulationThreadRunning())
+      startSimulationThread();
+    else if (!shouldRunThread)
+      stopSimulationThread();
+    if (player.isOpen())
     {
-      solver->update(period, numIter);
-      sa = new SpatialAccelarator{objects, cellSize};
+      if (isPlaying)
+      {
+        playbackFrame = (playbackFrame + 1) % std::max(static_cast<int>(player.getNumFrames()), 1);
+        showPlaybackFrame();
+      }
+    }
+    else if (isSimulationThreadRunning())
+    {
+      const SimulationSettings settings = currentSettings();
+      // a change that doesn't fit into the queue is sent at the next frame
+      if (settings != sentSettings && settingsQueue.push(settings))
+        sentSettings = settings;
+      if (snapshots.update())
+        showSnapshot(snapshots.getReadBuffer());
     }
     else
-      solver->updateOptimized(period, numIter, cellSize, sa);
+    {
+      stepSolver(*solver, currentSettings(), period);
+      if (mergeOverlapping)
+        mergeObjects();
+      if (shouldReorder(reorderEvery))
+        reorderObjects();
+      simTime += period;
+      if (recorder.isOpen() && ++numSteps % recordEvery == 0)
+        recorder.record(objects, simTime);
+      // exact solvers do not need the grid, build it only for the overlay
+      if (showAccGrid && solverMethod != SolverMethod::Approximate && solverMethod != SolverMethod::BarnesHut)
+        solver->spatialAccelarator.rebuild(objects, cellSize);
 
-    for (size_t ix = 0; const auto &obj : objects)
-      mesh->verts[ix++].position = {obj.pos.x, obj.pos.y, 0};
+      for (size_t ix = 0; const auto &obj : objects)
+        mesh->verts[ix++].position = {obj.pos.x, obj.pos.y, 0};
 
-    mesh->uploadData();
+      mesh->uploadData();
+    }
 
     const float widthF = static_cast<float>(width);
     const float heightF = static_cast<float>(height);
@@ -262,25 +752,92 @@ public:
 
     ImGui::Begin("Verlet Simulation");
     ImGui::Text("Frame dur: %.4f, FPS: %.1f", deltaTime, 1.0f / deltaTime);
+    ImGui::Checkbox("Simulation Thread", &useSimulationThread);
+    // objects and solver belong to the simulation thread while it runs, what the UI shows of them comes from its snapshot
+    const bool isThreaded = isSimulationThreadRunning();
+    const SimulationSnapshot &snap = snapshots.getReadBuffer();
+    if (isThreaded)
+    {
+      ImGui::SameLine();
+      ImGui::Text("steps/sec: %.0f, day %.2f", snap.stepsPerSecond, snap.simTime);
+    }
+    const size_t numCurrentObjects = isThreaded ? snap.positions.size() : objects.size();
+    const size_t numForceEvaluations = isThreaded ? snap.numForceEvaluations : solver->numForceEvaluations;
+    const int finestStepLevel = isThreaded ? snap.finestStepLevel : solver->finestStepLevel;
+    const double potential = isThreaded ? snap.potential : solver->potential;
+    const double kinetic = isThreaded ? snap.kinetic : solver->kinetic;
+    const bool isRecording = isThreaded ? snap.isRecording : recorder.isOpen();
 
     ImGui::Separator();
     ImGui::SliderFloat("cellSize", &cellSize, 0.001f, 0.5f, "%.4f");
     // if (ImGui::Button("Objs in SA"))
-    //   sa.debugPrint();
+    //   solver->spatialAccelarator.debugPrint();
     ImGui::SameLine();
-    static bool showAccGrid = true;
     ImGui::Checkbox("Show Acc Grid", &showAccGrid);
-    static int selObjIx = 0;
+    // 0 shows the grid's cells, higher values the coarser levels of its center of mass pyramid
+    static int accGridLevel = 0;
+    const int numAccGridLevels = isThreaded ? 1 : static_cast<int>(solver->spatialAccelarator.pyramid.size());
+    ImGui::SliderInt("Acc Grid Level", &accGridLevel, 0, std::max(numAccGridLevels - 1, 0));
     ImGui::InputInt("Selected Object", &selObjIx, 1, 10, ImGuiInputTextFlags_EnterReturnsTrue);
     // if (ImGui::Button("List Neighbors"))
     // {
     //   printf("Listing neighbors...\n");
-    //   for (auto &obj : sa.neighborsOf(objects[selObjIx]))
+    //   for (auto &obj : solver->spatialAccelarator.neighborsOf(objects[selObjIx]))
     //   {
     //     printf("(%g, %g)\n", obj.pos.x, obj.pos.y);
     //   }
     // }
-    ImGui::Checkbox("Approximate", &useApproximation);
+    ImGui::RadioButton("Exact", &solverMethod, SolverMethod::Exact);
+    ImGui::SameLine();
+    ImGui::RadioButton("Exact SoA", &solverMethod, SolverMethod::ExactSoA);
+    ImGui::SameLine();
+    ImGui::RadioButton("Approximate", &solverMethod, SolverMethod::Approximate);
+    ImGui::SameLine();
+    ImGui::RadioButton("Barnes-Hut", &solverMethod, SolverMethod::BarnesHut);
+    ImGui::SameLine();
+    ImGui::RadioButton("FMM", &solverMethod, SolverMethod::FastMultipole);
+    ImGui::SameLine();
+    ImGui::RadioButton("Block Steps", &solverMethod, SolverMethod::BlockSteps);
+    ImGui::SameLine();
+    ImGui::RadioButton("Exact Mixed", &solverMethod, SolverMethod::ExactMixed);
+    if (solverMethod == SolverMethod::ExactSoA || solverMethod == SolverMethod::ExactMixed)
+      ImGui::Text("SIMD kernel: %s", gravity::simdPathName);
+    ImGui::SliderFloat("theta", &theta, 0.0f, 1.5f, "%.2f");
+    ImGui::SliderInt("FMM order", &fmmOrder, 1, Fmm::maxOrder);
+    if (ImGui::Button("Validate FMM"))
+      withSimulationPaused([&]
+                           { validateFmm(period); });
+    if (fmmRmsRelativeError >= 0.0f)
+    {
+      ImGui::SameLine();
+      ImGui::Text("RMS rel. error: %.2e, FMM: %.2f ms/step, exact: %.2f ms/step", fmmRmsRelativeError, fmmStepMs, exactStepMs);
+    }
+    if (solverMethod == SolverMethod::BlockSteps)
+    {
+      ImGui::SliderInt("Max Step Level", &maxStepLevel, 0, 12);
+      ImGui::SliderFloat("Step eta", &stepEta, 0.001f, 0.1f, "%.3f");
+      // a shared step fine enough for the fastest object would evaluate every object at every one of its steps
+      const size_t sharedEvaluations = numCurrentObjects * numIter * (size_t{1} << finestStepLevel);
+      ImGui::Text("Force evals/frame: %zu, shared step: %zu (%.1fx)", numForceEvaluations, sharedEvaluations,
+                  static_cast<float>(sharedEvaluations) / static_cast<float>(std::max<size_t>(numForceEvaluations, 1)));
+    }
+    ImGui::Checkbox("Merge Overlapping", &mergeOverlapping);
+    ImGui::SameLine();
+    ImGui::Text("merged: %zu, objects: %zu", isThreaded ? snap.numMerged : numMerged, numCurrentObjects);
+    ImGui::SliderInt("Reorder Every", &reorderEvery, 0, 600);
+    if (ImGui::SliderInt("Threads", &numThreads, 1, static_cast<int>(ws::ThreadPool::defaultNumThreads())))
+      withSimulationPaused([&]
+                           {
+        threadPool = std::make_unique<ws::ThreadPool>(numThreads);
+        solver->threadPool = threadPool.get(); });
+    if (ImGui::Button("Measure Speed-up"))
+      withSimulationPaused([&]
+                           { measureSpeedUp(period); });
+    if (serialStepMs > 0.0f)
+    {
+      ImGui::SameLine();
+      ImGui::Text("serial: %.2f ms, %d threads: %.2f ms, %.2fx", serialStepMs, numThreads, parallelStepMs, serialStepMs / parallelStepMs);
+    }
 
     ImGui::Separator();
     static int numObjects = 200;
@@ -288,23 +845,122 @@ public:
     ImGui::InputInt("Num Objects", &numObjects, 1, 1, ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::SliderFloat("Speed Factor", &speedFactor, 0.00001f, 10.0f);
     if (ImGui::Button("Sun with N planets"))
-      setupSolarSystemFilledWithPlanets(numObjects, speedFactor);
+      withSimulationPaused([&]
+                           { setupSolarSystemFilledWithPlanets(numObjects, speedFactor); });
     ImGui::SameLine();
     if (ImGui::Button("Sun, Earth, Moon"))
-      setupSunEarthMoon();
+      withSimulationPaused([&]
+                           { setupSunEarthMoon(); });
 
     ImGui::Separator();
 
-    ImGui::InputFloat("Softening", &softening, 0.001f, 0.1f, "%.8f", ImGuiInputTextFlags_EnterReturnsTrue);
-    plotOriginalAndSoftenedGravitationalForces(gravitationalPotentialOriginal, gravitationalPotential, 2.0f, -1e-7f);
+    ImGui::Combo("Force Law", &forceLawIx, "Newtonian\0Plummer\0Spline Softened\0Lennard-Jones\0");
+    switch (forceLawIx)
+    {
+    case 0:
+      ImGui::InputFloat("Softening", &softening, 0.001f, 0.1f, "%.8f", ImGuiInputTextFlags_EnterReturnsTrue);
+      softening = std::max(softening, minSoftening);
+      break;
+    case 1:
+    case 2:
+      ImGui::InputFloat("Softening Length", &softeningLength, 0.0001f, 0.01f, "%.6f", ImGuiInputTextFlags_EnterReturnsTrue);
+      softeningLength = std::max(softeningLength, minSofteningLength);
+      break;
+    case 3:
+      ImGui::InputFloat("LJ epsilon", &ljEpsilon, 0.0f, 0.0f, "%.3e", ImGuiInputTextFlags_EnterReturnsTrue);
+      ImGui::InputFloat("LJ sigma", &ljSigma, 0.001f, 0.01f, "%.4f", ImGuiInputTextFlags_EnterReturnsTrue);
+      break;
+    }
+    // takes effect at the next update, which dispatches on it once. The simulation thread gets it with the settings.
+    if (!isThreaded)
+      solver->forceLaw = makeForceLaw();
+    plotOriginalAndSoftenedGravitationalForces(gravitationalPotentialOriginal, selectedPotential, 2.0f, -1e-7f);
 
     ImGui::Separator();
+    ImGui::Combo("Integrator", &integratorIx, "Velocity Verlet\0Yoshida 4\0Forest-Ruth\0PEFRL\0");
+    if (!isThreaded)
+      solver->integrationScheme = integrator::schemes[integratorIx];
+    if (ImGui::Button("Integrator Benchmark"))
+      withSimulationPaused([&]
+                           { runIntegratorBenchmark(numObjects, speedFactor); });
+    if (!integratorBenchmarkResults.empty() && ImGui::BeginTable("Integrators", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg))
+    {
+      for (const char *header : {"Setup", "Integrator", "Steps/day", "Force evals/day", "Max energy drift"})
+        ImGui::TableSetupColumn(header);
+      ImGui::TableHeadersRow();
+      for (const auto &r : integratorBenchmarkResults)
+      {
+        ImGui::TableNextRow();
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(r.scenario);
+        ImGui::TableNextColumn();
+        ImGui::TextUnformatted(r.scheme);
+        ImGui::TableNextColumn();
+        ImGui::Text("%d", r.stepsPerDay);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.0f", r.forceEvaluationsPerDay);
+        ImGui::TableNextColumn();
+        ImGui::Text("%.2e", r.maxEnergyDrift);
+      }
+      ImGui::EndTable();
+    }
+    ImGui::Separator();
+    ImGui::InputText("Trajectory File", trajectoryPath, sizeof(trajectoryPath));
+    if (!isRecording)
+    {
+      ImGui::Combo("Encoding", &trajectoryEncodingIx, "Float32\0Float16\0Delta16\0");
+      ImGui::SliderInt("Record Every", &recordEvery, 1, 60);
+      if (ImGui::Button("Record"))
+        withSimulationPaused([&]
+                             {
+          player.close();
+          recorder.open(trajectoryPath, objects, static_cast<trajectory::Encoding>(trajectoryEncodingIx)); });
+    }
+    else
+    {
+      if (ImGui::Button("Stop Recording"))
+        withSimulationPaused([&]
+                             { recorder.close(); });
+      ImGui::SameLine();
+      ImGui::Text("frames: %zu, dropped: %zu, queued: %zu, %.1f MB", isThreaded ? snap.numRecordedFrames : recorder.getNumFrames(),
+                  isThreaded ? snap.numDroppedFrames : recorder.getNumDroppedFrames(), recorder.getNumQueuedFrames(),
+                  static_cast<float>(recorder.getBytesWritten()) / (1024.0f * 1024.0f));
+    }
+    if (!player.isOpen())
+    {
+      ImGui::SameLine();
+      if (ImGui::Button("Play") && !isRecording)
+        openPlayback();
+    }
+    else
+    {
+      if (ImGui::SliderInt("Frame", &playbackFrame, 0, std::max(static_cast<int>(player.getNumFrames()) - 1, 0)))
+        showPlaybackFrame();
+      ImGui::Checkbox("Playing", &isPlaying);
+      ImGui::SameLine();
+      ImGui::Text("day %.2f of %zu objects", player.getNumFrames() > 0 ? player.getTime(playbackFrame) : 0.0, player.getNumObjects());
+      ImGui::SameLine();
+      if (ImGui::Button("Close"))
+        player.close();
+    }
+
+    ImGui::InputText("Checkpoint File", checkpointPath, sizeof(checkpointPath));
+    if (ImGui::Button("Save Checkpoint"))
+      withSimulationPaused([&]
+                           { saveCheckpoint(); });
+    ImGui::SameLine();
+    if (ImGui::Button("Restart from Checkpoint"))
+      withSimulationPaused([&]
+                           { loadCheckpoint(); });
+
     ImGui::InputFloat("Speed (days/sec)", &speed, 0.001f, 0, "%.4f", ImGuiInputTextFlags_EnterReturnsTrue);
     ImGui::SliderInt("NumIter", &numIter, 1, 16);
     ImGui::Text("cam pos: (%g, %G), size: (%g, %G)", camera->position.x, camera->position.y, camera->width, camera->height);
-    static int objIx = -1;
     ImGui::InputInt("Camera Follows Object", &objIx, 1, 10, ImGuiInputTextFlags_EnterReturnsTrue);
-    if (objIx > -1)
+    // a button above may have just replaced the objects, sizes are checked again
+    if (isSimulationThreadRunning() && objIx > -1 && objIx < static_cast<int>(snap.positions.size()))
+      camera->position = snap.positions[objIx];
+    else if (!isSimulationThreadRunning() && objIx > -1 && objIx < static_cast<int>(objects.size()))
       camera->position = objects[objIx].pos;
 
     ImGui::Separator();
@@ -318,9 +974,9 @@ public:
     if (showImGuiDemo)
       ImGui::ShowDemoWindow();
 
-    ImGui::Text("Potential: %+3.2e, Kinetic: %+3.2e, Total: %+3.2e", solver->potential, solver->kinetic, solver->potential + solver->kinetic);
+    ImGui::Text("Potential: %+3.2e, Kinetic: %+3.2e, Total: %+3.2e", potential, kinetic, potential + kinetic);
     static EnergiesPlot eplt{5 * 60}; // approx N sec in 60 FPS
-    eplt.addEnergyPoints(time, solver->potential, solver->kinetic, solver->potential + solver->kinetic);
+    eplt.addEnergyPoints(time, static_cast<float>(potential), static_cast<float>(kinetic), static_cast<float>(potential + kinetic));
     eplt.plot({-1, 600});
     ImGui::End();
 
@@ -332,28 +988,59 @@ public:
     const std::array<uint32_t, 8> relativeIdxs = {0, 1, 1, 2, 2, 3, 3, 0};
     const std::array<glm::vec2, 4> relativePoses = {glm::vec2{0, 0}, {1, 0}, {1, 1}, {0, 1}};
 
-    if (sa != nullptr)
+    if (isThreaded)
+    {
+      // tree and grid belong to the simulation thread, no overlay
+      debugMesh->uploadData();
+    }
+    else if (solverMethod == SolverMethod::BarnesHut)
     {
-      for (auto &[key, vec] : sa->cache)
+      // leaves of the Barnes-Hut tree instead of the grid
+      for (const auto &node : solver->quadTree.nodes)
       {
-        const float x = static_cast<float>(key.first) * cellSize;
-        const float y = static_cast<float>(key.second) * cellSize;
+        if (node.firstChild != -1 || node.firstObject == -1)
+          continue;
         const float z = -0.1f;
         for (const auto &rp : relativePoses)
-          debugMesh->verts.emplace_back(glm::vec3{x + rp.x * cellSize, y + rp.y * cellSize, z});
+          debugMesh->verts.emplace_back(glm::vec3{node.center.x + (rp.x * 2 - 1) * node.halfSize, node.center.y + (rp.y * 2 - 1) * node.halfSize, z});
 
         for (auto relIx : relativeIdxs)
           debugMesh->idxs.push_back(saGridIdx + relIx);
         saGridIdx += static_cast<uint32_t>(relativePoses.size());
       }
-      delete sa;
+      debugMesh->uploadData();
+    }
+    else if (showAccGrid && !solver->spatialAccelarator.pyramid.empty())
+    {
+      const SpatialAccelarator &sa = solver->spatialAccelarator;
+      const int level = std::min(accGridLevel, static_cast<int>(sa.pyramid.size()) - 1);
+      const SpatialAccelarator::PyramidLevel &pl = sa.pyramid[level];
+      const float levelCellSize = sa.cellSize * static_cast<float>(1 << level);
+      for (int j = 0; j < pl.numCellsY; ++j)
+        for (int i = 0; i < pl.numCellsX; ++i)
+        {
+          if (pl.cellAverages[j * pl.numCellsX + i].mass == 0)
+            continue;
+          const float x = static_cast<float>(sa.minKey.first) * sa.cellSize + static_cast<float>(i) * levelCellSize;
+          const float y = static_cast<float>(sa.minKey.second) * sa.cellSize + static_cast<float>(j) * levelCellSize;
+          const float z = -0.1f;
+          for (const auto &rp : relativePoses)
+            debugMesh->verts.emplace_back(glm::vec3{x + rp.x * levelCellSize, y + rp.y * levelCellSize, z});
+
+          for (auto relIx : relativeIdxs)
+            debugMesh->idxs.push_back(saGridIdx + relIx);
+          saGridIdx += static_cast<uint32_t>(relativePoses.size());
+        }
       debugMesh->uploadData();
     }
 
     pointShader->bind();
     pointShader->setVector2fv("RenderTargetSize", rts);
     pointShader->setMatrix4fv("ProjectionFromView", glm::value_ptr(camera->getProjectionFromView()));
-    mesh->draw();
+    if (player.isOpen())
+      playbackMesh->draw();
+    else
+      mesh->draw();
 
     if (showAccGrid)
     {
@@ -366,6 +1053,8 @@ public:
 
   void onDeinit() final
   {
+    stopSimulationThread();
+    recorder.close();
   }
 };
 
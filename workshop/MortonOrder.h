@@ -0,0 +1,111 @@
+#pragma once
+
+#include <glm/vec2.hpp>
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ws
+{
+  // Interleaves the bits of x and y into a Z-order curve key, x in the even bits
+  inline uint64_t mortonKey(uint32_t x, uint32_t y)
+  {
+    const auto spread = [](uint64_t v)
+    {
+      v = (v | (v << 16)) & 0x0000FFFF0000FFFFull;
+      v = (v | (v << 8)) & 0x00FF00FF00FF00FFull;
+      v = (v | (v << 4)) & 0x0F0F0F0F0F0F0F0Full;
+      v = (v | (v << 2)) & 0x3333333333333333ull;
+      v = (v | (v << 1)) & 0x5555555555555555ull;
+      return v;
+    };
+    return spread(x) | (spread(y) << 1);
+  }
+
+  // Permutation that sorts 2D points along a Z-order (Morton) curve over their bounding box, so that points close in
+  // space get close indices and passes over neighbors touch nearby memory. Coordinates are quantized to 32 bits each and
+  // the 64-bit keys are sorted by an LSD radix sort, 8 bits per pass. Passes in which all keys have the same digit, e.g.
+  // the high bits of a compact cluster, are skipped. The sort is stable. Vectors keep their capacity across compute() calls.
+  class MortonOrder
+  {
+  public:
+    // order[new index] = old index, remap[old index] = new index
+    std::vector<uint32_t> order;
+    std::vector<uint32_t> remap;
+
+    // pos(ix) returns the glm::vec2 position of point ix in [0, count)
+    template <typename PositionFn>
+    void compute(size_t count, PositionFn &&pos)
+    {
+      keys.resize(count);
+      order.resize(count);
+      remap.resize(count);
+      if (count == 0)
+        return;
+
+      glm::vec2 minPos = pos(0);
+      glm::vec2 maxPos = minPos;
+      for (size_t ix = 1; ix < count; ++ix)
+      {
+        const glm::vec2 p = pos(ix);
+        minPos = {std::min(minPos.x, p.x), std::min(minPos.y, p.y)};
+        maxPos = {std::max(maxPos.x, p.x), std::max(maxPos.y, p.y)};
+      }
+      // in double, float has too few bits for 32-bit quantization
+      const double maxCoord = 4294967295.0;
+      const double scaleX = maxPos.x > minPos.x ? maxCoord / (static_cast<double>(maxPos.x) - minPos.x) : 0.0;
+      const double scaleY = maxPos.y > minPos.y ? maxCoord / (static_cast<double>(maxPos.y) - minPos.y) : 0.0;
+      for (size_t ix = 0; ix < count; ++ix)
+      {
+        const glm::vec2 p = pos(ix);
+        const double qx = std::clamp((static_cast<double>(p.x) - minPos.x) * scaleX, 0.0, maxCoord);
+        const double qy = std::clamp((static_cast<double>(p.y) - minPos.y) * scaleY, 0.0, maxCoord);
+        keys[ix] = mortonKey(static_cast<uint32_t>(qx), static_cast<uint32_t>(qy));
+        order[ix] = static_cast<uint32_t>(ix);
+      }
+
+      sortedKeys.resize(count);
+      sortedOrder.resize(count);
+      for (int shift = 0; shift < 64; shift += 8)
+      {
+        std::array<size_t, 257> starts{};
+        for (const uint64_t key : keys)
+          ++starts[((key >> shift) & 0xFF) + 1];
+        if (std::find(starts.begin(), starts.end(), count) != starts.end())
+          continue;
+        for (size_t d = 0; d < 256; ++d)
+          starts[d + 1] += starts[d];
+        for (size_t k = 0; k < count; ++k)
+        {
+          const size_t dst = starts[(keys[k] >> shift) & 0xFF]++;
+          sortedKeys[dst] = keys[k];
+          sortedOrder[dst] = order[k];
+        }
+        keys.swap(sortedKeys);
+        order.swap(sortedOrder);
+      }
+
+      for (size_t k = 0; k < count; ++k)
+        remap[order[k]] = static_cast<uint32_t>(k);
+    }
+
+  private:
+    std::vector<uint64_t> keys;
+    // destinations of a radix sort pass, swapped with keys and order after it
+    std::vector<uint64_t> sortedKeys;
+    std::vector<uint32_t> sortedOrder;
+  };
+
+  // Moves items[old] to items[remap[old]] for old in [0, remap.size()), items beyond, e.g. padding, stay where they are
+  template <typename Container>
+  void permuteByRemap(Container &items, const std::vector<uint32_t> &remap)
+  {
+    Container permuted = items;
+    for (size_t old = 0; old < remap.size(); ++old)
+      permuted[remap[old]] = items[old];
+    items.swap(permuted);
+  }
+}
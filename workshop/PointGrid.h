@@ -0,0 +1,104 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace ws
+{
+  // Spatial hash of 3D points for fixed-radius neighbor queries. Space is cut into cubes of cellSize, which are hashed
+  // into a table of about twice as many buckets as points, so memory doesn't depend on how far the points spread.
+  // Rebuilt from scratch by a counting sort of the points into buckets, linear in the number of points. Positions are
+  // copied in bucket order, a query reads the points of a cell contiguously. Vectors keep their capacity across rebuilds.
+  class PointGrid
+  {
+  public:
+    float cellSize = 1.0f;
+
+    // pos(ix) returns the glm::vec3 position of point ix in [0, count). Queries are cheapest with radii up to cellSize.
+    template <typename PositionFn>
+    void rebuild(size_t count, float newCellSize, PositionFn &&pos)
+    {
+      cellSize = std::max(newCellSize, 1e-6f);
+      size_t numBuckets = 1;
+      while (numBuckets < 2 * count)
+        numBuckets *= 2;
+      bucketMask = static_cast<uint32_t>(numBuckets - 1);
+
+      // count points per bucket, shifted by one so that the prefix sum below turns counts into starts
+      cellOfPoint.resize(count);
+      bucketStarts.assign(numBuckets + 1, 0);
+      for (size_t ix = 0; ix < count; ++ix)
+      {
+        cellOfPoint[ix] = cellOf(pos(ix));
+        ++bucketStarts[bucketOf(cellOfPoint[ix]) + 1];
+      }
+      for (size_t b = 0; b < numBuckets; ++b)
+        bucketStarts[b + 1] += bucketStarts[b];
+
+      bucketCursors.assign(bucketStarts.begin(), bucketStarts.end() - 1);
+      sortedPositions.resize(count);
+      sortedCells.resize(count);
+      sortedIdxs.resize(count);
+      for (size_t ix = 0; ix < count; ++ix)
+      {
+        const uint32_t dst = bucketCursors[bucketOf(cellOfPoint[ix])]++;
+        sortedPositions[dst] = pos(ix);
+        sortedCells[dst] = cellOfPoint[ix];
+        sortedIdxs[dst] = static_cast<uint32_t>(ix);
+      }
+    }
+
+    glm::ivec3 cellOf(const glm::vec3 &p) const
+    {
+      return {static_cast<int32_t>(std::floor(p.x / cellSize)), static_cast<int32_t>(std::floor(p.y / cellSize)), static_cast<int32_t>(std::floor(p.z / cellSize))};
+    }
+
+    // Calls fn(index, position) for every point closer than radius to center, including one at center itself
+    template <typename Fn>
+    void forEachWithin(const glm::vec3 &center, float radius, Fn &&fn) const
+    {
+      if (sortedIdxs.empty())
+        return;
+      const float radiusSqr = radius * radius;
+      const glm::ivec3 lo = cellOf(center - glm::vec3{radius, radius, radius});
+      const glm::ivec3 hi = cellOf(center + glm::vec3{radius, radius, radius});
+      for (int32_t z = lo.z; z <= hi.z; ++z)
+        for (int32_t y = lo.y; y <= hi.y; ++y)
+          for (int32_t x = lo.x; x <= hi.x; ++x)
+          {
+            const glm::ivec3 cell{x, y, z};
+            const uint32_t b = bucketOf(cell);
+            for (uint32_t k = bucketStarts[b]; k < bucketStarts[b + 1]; ++k)
+            {
+              // other cells hash into the same bucket, skipping them also keeps points from being visited twice
+              if (sortedCells[k] != cell)
+                continue;
+              const glm::vec3 d = sortedPositions[k] - center;
+              if (d.x * d.x + d.y * d.y + d.z * d.z < radiusSqr)
+                fn(sortedIdxs[k], sortedPositions[k]);
+            }
+          }
+    }
+
+  private:
+    uint32_t bucketOf(const glm::ivec3 &cell) const
+    {
+      const uint32_t h = static_cast<uint32_t>(cell.x) * 73856093u ^ static_cast<uint32_t>(cell.y) * 19349663u ^ static_cast<uint32_t>(cell.z) * 83492791u;
+      return h & bucketMask;
+    }
+
+    uint32_t bucketMask{};
+    std::vector<glm::ivec3> cellOfPoint;
+    std::vector<uint32_t> bucketStarts;
+    // write positions of the counting sort's scatter, kept to reuse its allocation
+    std::vector<uint32_t> bucketCursors;
+    std::vector<glm::vec3> sortedPositions;
+    std::vector<glm::ivec3> sortedCells;
+    std::vector<uint32_t> sortedIdxs;
+  };
+}
@@ -0,0 +1,95 @@
+#include "PointMesh.h"
+
+#include <glad/gl.h>
+
+#include <algorithm>
+#include <cstddef>
+
+namespace ws
+{
+  PointMesh::PointMesh(size_t capacity)
+      : capacity{capacity}, positions(capacity), attributes(capacity)
+  {
+    glGenVertexArrays(1, &vao);
+    glGenBuffers(1, &positionVbo);
+    glGenBuffers(1, &attributeVbo);
+    glGenBuffers(1, &ebo);
+    glBindVertexArray(vao);
+
+    glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec2) * capacity, nullptr, GL_STREAM_DRAW);
+    glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(glm::vec2), (void *)0);
+    glEnableVertexAttribArray(0);
+
+    glBindBuffer(GL_ARRAY_BUFFER, attributeVbo);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(PointAttributes) * capacity, attributes.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(3, 4, GL_FLOAT, GL_FALSE, sizeof(PointAttributes), (void *)offsetof(PointAttributes, color));
+    glEnableVertexAttribArray(3);
+    glVertexAttribPointer(4, 4, GL_FLOAT, GL_FALSE, sizeof(PointAttributes), (void *)offsetof(PointAttributes, custom1));
+    glEnableVertexAttribArray(4);
+
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ebo);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint32_t) * capacity, nullptr, GL_STATIC_DRAW);
+
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+  }
+
+  PointMesh::~PointMesh()
+  {
+    glDeleteBuffers(1, &positionVbo);
+    glDeleteBuffers(1, &attributeVbo);
+    glDeleteBuffers(1, &ebo);
+    glDeleteVertexArrays(1, &vao);
+  }
+
+  void PointMesh::setAttributes(uint32_t slot, const PointAttributes &attr)
+  {
+    attributes[slot] = attr;
+    if (dirtyBegin == dirtyEnd)
+    {
+      dirtyBegin = slot;
+      dirtyEnd = slot + 1;
+      return;
+    }
+    dirtyBegin = std::min(dirtyBegin, slot);
+    dirtyEnd = std::max(dirtyEnd, slot + 1);
+  }
+
+  void PointMesh::setDrawnSlots(const std::vector<uint32_t> &slots)
+  {
+    idxs.assign(slots.begin(), slots.begin() + std::min(slots.size(), capacity));
+    areIndicesDirty = true;
+  }
+
+  void PointMesh::uploadData(size_t numSlots)
+  {
+    numSlots = std::min(numSlots, capacity);
+    glBindVertexArray(vao);
+    if (numSlots > 0)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, positionVbo);
+      glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(glm::vec2) * numSlots, positions.data());
+    }
+    if (dirtyBegin < dirtyEnd)
+    {
+      glBindBuffer(GL_ARRAY_BUFFER, attributeVbo);
+      glBufferSubData(GL_ARRAY_BUFFER, sizeof(PointAttributes) * dirtyBegin, sizeof(PointAttributes) * (dirtyEnd - dirtyBegin), attributes.data() + dirtyBegin);
+      dirtyBegin = dirtyEnd = 0;
+    }
+    if (areIndicesDirty)
+    {
+      // the element buffer is part of the VAO's state
+      glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, 0, sizeof(uint32_t) * idxs.size(), idxs.data());
+      areIndicesDirty = false;
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glBindVertexArray(0);
+  }
+
+  void PointMesh::draw() const
+  {
+    glBindVertexArray(vao);
+    glDrawElements(GL_POINTS, static_cast<GLsizei>(idxs.size()), GL_UNSIGNED_INT, 0);
+  }
+}
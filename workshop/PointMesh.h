@@ -0,0 +1,56 @@
+#pragma once
+
+#include "Common.h"
+
+#include <glm/vec2.hpp>
+#include <glm/vec4.hpp>
+
+#include <vector>
+
+namespace ws
+{
+  // Per point data that rarely changes
+  struct PointAttributes
+  {
+    glm::vec4 color = {1, 1, 1, 1};
+    glm::vec4 custom1;
+  };
+
+  // Fixed number of point slots whose positions change every frame but little else does, e.g. particles.
+  // Positions have a buffer of their own, a frame uploads 8 bytes per point instead of a whole DefaultVertex.
+  // Attributes and indices (the slots to draw) live in buffers that are only written where they changed.
+  // Attribute locations match DefaultVertex: 0 position (z = 0), 3 color, 4 custom1.
+  class PointMesh
+  {
+  public:
+    PointMesh(size_t capacity);
+    ~PointMesh();
+    PointMesh(const PointMesh &) = delete;
+    PointMesh &operator=(const PointMesh &) = delete;
+
+    const size_t capacity;
+    // by slot, written by the user and uploaded by uploadData()
+    std::vector<glm::vec2> positions;
+
+    // uploaded with the next uploadData(), changed slots are uploaded as one range
+    void setAttributes(uint32_t slot, const PointAttributes &attributes);
+    void setDrawnSlots(const std::vector<uint32_t> &slots);
+    // uploads the positions of slots [0, numSlots) and the attributes and indices changed since the last call
+    void uploadData(size_t numSlots);
+
+    void draw() const;
+
+  private:
+    std::vector<PointAttributes> attributes;
+    std::vector<uint32_t> idxs;
+    // range of slots whose attributes changed
+    uint32_t dirtyBegin{};
+    uint32_t dirtyEnd{};
+    bool areIndicesDirty = false;
+
+    uint32_t vao{INVALID};
+    uint32_t positionVbo{INVALID};
+    uint32_t attributeVbo{INVALID};
+    uint32_t ebo{INVALID};
+  };
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <optional>
+
+namespace ws
+{
+  // Lock-free bounded queue for exactly one producer and one consumer thread, a ring buffer of Capacity slots.
+  // push() fails instead of waiting when the queue is full, pop() returns nothing when it is empty.
+  template <typename T, size_t Capacity>
+  class SpscQueue
+  {
+    static_assert(Capacity > 0 && (Capacity & (Capacity - 1)) == 0, "Capacity has to be a power of two");
+
+  public:
+    bool push(const T &value)
+    {
+      const size_t head = headIx.load(std::memory_order_relaxed);
+      if (head - tailIx.load(std::memory_order_acquire) == Capacity)
+        return false;
+      slots[head & (Capacity - 1)] = value;
+      headIx.store(head + 1, std::memory_order_release);
+      return true;
+    }
+
+    std::optional<T> pop()
+    {
+      const size_t tail = tailIx.load(std::memory_order_relaxed);
+      if (tail == headIx.load(std::memory_order_acquire))
+        return std::nullopt;
+      std::optional<T> value = slots[tail & (Capacity - 1)];
+      tailIx.store(tail + 1, std::memory_order_release);
+      return value;
+    }
+
+  private:
+    std::array<T, Capacity> slots{};
+    // written by the producer and the consumer respectively, on separate cache lines
+    alignas(64) std::atomic<size_t> headIx{0};
+    alignas(64) std::atomic<size_t> tailIx{0};
+  };
+}
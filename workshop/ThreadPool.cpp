@@ -0,0 +1,118 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace ws
+{
+  ThreadPool::ThreadPool(size_t numThreads)
+  {
+    numThreads = std::max<size_t>(numThreads, 1);
+    for (size_t ix = 0; ix < numThreads; ++ix)
+      queues.push_back(std::make_unique<WorkQueue>());
+    // queue 0 belongs to the thread calling parallelFor()
+    for (size_t ix = 1; ix < numThreads; ++ix)
+      workers.emplace_back(&ThreadPool::workerLoop, this, ix);
+  }
+
+  ThreadPool::~ThreadPool()
+  {
+    {
+      std::lock_guard<std::mutex> lock(sleepMutex);
+      isStopping = true;
+    }
+    wakeUp.notify_all();
+    for (auto &worker : workers)
+      worker.join();
+  }
+
+  size_t ThreadPool::defaultNumThreads()
+  {
+    return std::max<size_t>(std::thread::hardware_concurrency(), 1);
+  }
+
+  void ThreadPool::run(Job &job, size_t numChunks)
+  {
+    // deal chunks round-robin, stealing evens out the rest
+    for (size_t c = 0; c < numChunks; ++c)
+    {
+      WorkQueue &queue = *queues[c % queues.size()];
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.tasks.push_back(Task{&job, c});
+    }
+    numQueuedTasks += numChunks;
+    {
+      // taking the lock orders the increment above before a worker's check in wait(), no wake up gets lost
+      std::lock_guard<std::mutex> lock(sleepMutex);
+    }
+    wakeUp.notify_all();
+
+    // help until every chunk of this job is done, including the ones other threads are still running
+    Task task;
+    while (job.remaining.load(std::memory_order_acquire) > 0)
+    {
+      if (popOrSteal(0, task))
+        execute(task);
+      else
+        std::this_thread::yield();
+    }
+  }
+
+  void ThreadPool::workerLoop(size_t queueIx)
+  {
+    Task task;
+    while (true)
+    {
+      if (popOrSteal(queueIx, task))
+      {
+        execute(task);
+        continue;
+      }
+
+      std::unique_lock<std::mutex> lock(sleepMutex);
+      wakeUp.wait(lock, [this]
+                  { return isStopping || numQueuedTasks.load() > 0; });
+      if (isStopping)
+        return;
+    }
+  }
+
+  bool ThreadPool::popOrSteal(size_t queueIx, Task &task)
+  {
+    // own queue: newest first, it is the most likely to be in cache
+    {
+      WorkQueue &own = *queues[queueIx];
+      std::lock_guard<std::mutex> lock(own.mutex);
+      if (!own.tasks.empty())
+      {
+        task = own.tasks.back();
+        own.tasks.pop_back();
+        --numQueuedTasks;
+        return true;
+      }
+    }
+
+    // others' queues: oldest first
+    for (size_t k = 1; k < queues.size(); ++k)
+    {
+      WorkQueue &victim = *queues[(queueIx + k) % queues.size()];
+      std::lock_guard<std::mutex> lock(victim.mutex);
+      if (!victim.tasks.empty())
+      {
+        task = victim.tasks.front();
+        victim.tasks.pop_front();
+        --numQueuedTasks;
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void ThreadPool::execute(const Task &task)
+  {
+    Job &job = *task.job;
+    const size_t begin = task.chunkIx * job.chunkSize;
+    const size_t end = std::min(job.count, begin + job.chunkSize);
+    job.invoke(job.context, task.chunkIx, begin, end);
+    job.remaining.fetch_sub(1, std::memory_order_release);
+  }
+}
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <type_traits>
+#include <vector>
+
+namespace ws
+{
+  // Work-stealing thread pool for data-parallel loops.
+  // Every thread owns a queue of tasks. It pops from the back of its own queue and, when that is empty,
+  // steals from the front of the others'. The thread calling parallelFor() works through queue 0 as well,
+  // hence a pool of N threads starts N - 1 workers and a pool of 1 thread runs everything inline.
+  class ThreadPool
+  {
+  public:
+    explicit ThreadPool(size_t numThreads = defaultNumThreads());
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    size_t getNumThreads() const { return queues.size(); }
+
+    // Splits [0, count) into chunks of chunkSize and calls fn(chunkIx, begin, end) for each of them, returns when all are done.
+    // Chunk boundaries depend only on count and chunkSize, never on the number of threads. Partial results stored per chunk
+    // and combined in chunk order are therefore reproducible regardless of how many threads ran them.
+    // Not reentrant: fn must not call parallelFor() of the same pool.
+    template <typename Fn>
+    void parallelFor(size_t count, size_t chunkSize, Fn &&fn)
+    {
+      const size_t numChunks = (count + chunkSize - 1) / chunkSize;
+      if (numChunks == 0)
+        return;
+      if (numChunks == 1 || queues.size() == 1)
+      {
+        for (size_t c = 0; c < numChunks; ++c)
+          fn(c, c * chunkSize, std::min(count, (c + 1) * chunkSize));
+        return;
+      }
+
+      Job job;
+      job.count = count;
+      job.chunkSize = chunkSize;
+      job.context = &fn;
+      job.invoke = [](void *context, size_t chunkIx, size_t begin, size_t end)
+      { (*static_cast<std::remove_reference_t<Fn> *>(context))(chunkIx, begin, end); };
+      job.remaining = numChunks;
+      run(job, numChunks);
+    }
+
+    // Suggested number of threads for a pool: all hardware threads, at least 1.
+    static size_t defaultNumThreads();
+
+  private:
+    struct Job
+    {
+      size_t count{};
+      size_t chunkSize{};
+      void *context{};
+      void (*invoke)(void *context, size_t chunkIx, size_t begin, size_t end){};
+      std::atomic<size_t> remaining{};
+    };
+
+    struct Task
+    {
+      Job *job{};
+      size_t chunkIx{};
+    };
+
+    struct WorkQueue
+    {
+      std::mutex mutex;
+      std::deque<Task> tasks;
+    };
+
+    void run(Job &job, size_t numChunks);
+    void workerLoop(size_t queueIx);
+    bool popOrSteal(size_t queueIx, Task &task);
+    static void execute(const Task &task);
+
+    std::vector<std::unique_ptr<WorkQueue>> queues;
+    std::vector<std::thread> workers;
+
+    // number of tasks sitting in queues, workers sleep while it is 0
+    std::atomic<size_t> numQueuedTasks{};
+    std::mutex sleepMutex;
+    std::condition_variable wakeUp;
+    bool isStopping = false;
+  };
+
+  // fn(chunkIx, begin, end) for the chunks of [0, count) as cut by parallelFor(), on threadPool, or one after the other
+  // on the calling thread if it's nullptr. For code that runs with or without a pool.
+  template <typename Fn>
+  void forEachChunk(ThreadPool *threadPool, size_t count, size_t chunkSize, Fn &&fn)
+  {
+    if (threadPool != nullptr)
+      threadPool->parallelFor(count, chunkSize, fn);
+    else
+      for (size_t begin = 0; begin < count; begin += chunkSize)
+        fn(begin / chunkSize, begin, std::min(count, begin + chunkSize));
+  }
+}
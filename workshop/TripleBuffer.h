@@ -0,0 +1,45 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+
+namespace ws
+{
+  // Lock-free triple buffer passing the latest value from one producer thread to one consumer thread.
+  // The producer fills getWriteBuffer() and publish()es it, the consumer calls update() and reads getReadBuffer().
+  // Neither side ever waits: the third buffer is the one in between, which publish() and update() swap their own with.
+  // Values published while the consumer is not looking are overwritten, the consumer always gets the latest one.
+  // Buffers are reused, e.g. vectors in T keep their capacity.
+  template <typename T>
+  class TripleBuffer
+  {
+  public:
+    // producer side
+    T &getWriteBuffer() { return buffers[writeIx]; }
+    void publish()
+    {
+      writeIx = shared.exchange(static_cast<uint8_t>(writeIx | freshBit), std::memory_order_acq_rel) & indexMask;
+    }
+
+    // consumer side. Returns whether there is a value that was not seen yet, which getReadBuffer() refers to then.
+    bool update()
+    {
+      if ((shared.load(std::memory_order_relaxed) & freshBit) == 0)
+        return false;
+      readIx = shared.exchange(readIx, std::memory_order_acq_rel) & indexMask;
+      return true;
+    }
+    const T &getReadBuffer() const { return buffers[readIx]; }
+
+  private:
+    static constexpr uint8_t indexMask = 0x3;
+    static constexpr uint8_t freshBit = 0x4;
+
+    std::array<T, 3> buffers{};
+    uint8_t writeIx = 0;
+    uint8_t readIx = 1;
+    // index of the buffer in between, with freshBit set when it was published and not taken yet
+    std::atomic<uint8_t> shared{2};
+  };
+}